@@ -4,50 +4,35 @@
 
 #include "Boid.h"
 
+#include "BoidKernel.h"
 #include "raymath.h"
 #include "../sim/util.h"
 
 
 namespace swarmulator {
-     void Boid::update(const std::list<SimObject *> &neighborhood, const float dt) {
-        Vector3 cohesion = {0, 0, 0};
-        u_int32_t coc = 0;
-        Vector3 avoidance = {0, 0, 0};
-        u_int32_t alc = 0;
-        Vector3 alignment = {0, 0, 0};
-
-        for (auto neighbor : neighborhood) {
-            if (dynamic_cast<Boid*>(neighbor) != nullptr) {
-                // if this is a boid do boid stuff
-                const auto diff = position_ - neighbor->get_position();
-                const auto dist = Vector3Distance(neighbor->get_position(), position_);
-                if (dist < interaction_radius_ / 2.f) { // if the other agent is really close to us, avoid it
-                    auto d = Vector3Length(diff);
-                    avoidance = avoidance + diff / (1 + d); // watch the divide by 0!
-                }
-                // always do cohesion and alignment
-                cohesion = cohesion + neighbor->get_position();
-                coc++;
-                alignment = alignment + neighbor->get_rotation();
-                alc++;
-            }
-            else if (dynamic_cast<BoidEffector*>(neighbor) != nullptr) {
-                // if this is a boid effector just do avoidance
-                const auto diff = position_ - neighbor->get_position();
-                auto d = Vector3Length(diff);
-                avoidance = avoidance + (10 * (diff / (1 + d))); // be REALLY scared of effectors
-            }
-        }
-
-        if (coc > 0) {
-            cohesion = cohesion / static_cast<float>(coc);
+     void Boid::update(const Neighborhood &neighborhood, const float dt) {
+        // gather neighbors into flat arrays for the flocking kernel (one set per thread, reused between updates)
+        static thread_local boid_kernel::neighbor_batch boids, effectors;
+        boids.clear();
+        effectors.clear();
+        neighborhood.for_each_neighbor<Boid>([&](const Boid &boid, const Vector3 &position) {
+            boids.push(position, boid.get_rotation());
+        });
+        neighborhood.for_each_neighbor<BoidEffector>([&](const BoidEffector &, const Vector3 &position) {
+            effectors.push(position, Vector3(0, 0, 0));
+        });
+
+        // boids: avoid the really close ones, always do cohesion and alignment
+        auto [cohesion, alignment, avoidance, count] = boid_kernel::flock(position_, interaction_radius_ / 2.f, boids);
+        // effectors: just avoidance, but be REALLY scared of them
+        avoidance = avoidance + boid_kernel::avoid(position_, 10, effectors);
+
+        if (count > 0) {
+            cohesion = cohesion / static_cast<float>(count);
+            alignment = alignment / static_cast<float>(count);
         }
         cohesion = Vector3Normalize(cohesion - position_);
 
-        if (alc > 0) {
-            alignment = alignment / static_cast<float>(alc);
-        }
-
         const auto steer_dir = cohesion_wt_ * cohesion + avoidance_wt_ * avoidance + alignment_wt_ * (alignment - rotation_);
 
         const float ip = std::expf(-7 * dt);
@@ -18,10 +18,23 @@ public:
     Boid() = default;
     Boid(const Vector3 position, const Vector3 rotation) : SimObject(position, rotation) {}
 
-    void update(const std::list<SimObject *> &neighborhood, float dt) override;
+    void update(const Neighborhood &neighborhood, float dt) override;
 
     std::string type_name() const override { return "Boid"; };
-    std::vector<float> log() const override { return  { static_cast<float>(id_), position_.x, position_.y, position_.z, rotation_.x, rotation_.y, rotation_.z }; }
+    void log_row(std::vector<float> &row) const override { row.insert(row.end(), { static_cast<float>(id_), position_.x, position_.y, position_.z, rotation_.x, rotation_.y, rotation_.z }); }
+
+    void save_state(state_writer &out) const override {
+        SimObject::save_state(out);
+        out.put(cohesion_wt_);
+        out.put(avoidance_wt_);
+        out.put(alignment_wt_);
+    }
+    void restore_state(state_reader &in) override {
+        SimObject::restore_state(in);
+        in.get(cohesion_wt_);
+        in.get(avoidance_wt_);
+        in.get(alignment_wt_);
+    }
 };
 
 class BoidEffector final : public SimObject {
@@ -30,7 +43,10 @@ public:
     BoidEffector(const Vector3 position, const Vector3 rotation) : SimObject(position, rotation) {}
 
     std::string type_name() const override { return "BoidEffector"; }
-    std::vector<float> log() const override { return { static_cast<float>(id_), position_.x, position_.y, position_.z }; };
+    void log_row(std::vector<float> &row) const override { row.insert(row.end(), { static_cast<float>(id_), position_.x, position_.y, position_.z }); };
+    std::vector<log_range> log_ranges(const Vector3 &world_size) const override {
+        return { {1, -world_size.x / 2, world_size.x / 2}, {2, -world_size.y / 2, world_size.y / 2}, {3, -world_size.z / 2, world_size.z / 2} };
+    }
 };
 
 }
@@ -0,0 +1,174 @@
+//
+// Created by moltma on 11/3/25.
+//
+
+#include "BoidKernel.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SWARMULATOR_X86
+#include <immintrin.h>
+#endif
+
+namespace swarmulator::boid_kernel {
+    namespace {
+        // the scalar version of the kernel, over neighbors [begin, end)
+        // also finishes off whatever the vector kernels leave over at the end
+        void flock_scalar(const Vector3 &self, const float avoidance_radius, const neighbor_batch &boids, const size_t begin, flock_sums &sums) {
+            for (size_t i = begin; i < boids.size(); i++) {
+                const float dx = self.x - boids.x[i];
+                const float dy = self.y - boids.y[i];
+                const float dz = self.z - boids.z[i];
+                const float d = std::sqrt(dx * dx + dy * dy + dz * dz);
+                if (d < avoidance_radius) { // if the other agent is really close to us, avoid it
+                    const float f = 1.f / (1.f + d); // watch the divide by 0!
+                    sums.avoidance.x += dx * f;
+                    sums.avoidance.y += dy * f;
+                    sums.avoidance.z += dz * f;
+                }
+                // always do cohesion and alignment
+                sums.cohesion.x += boids.x[i];
+                sums.cohesion.y += boids.y[i];
+                sums.cohesion.z += boids.z[i];
+                sums.alignment.x += boids.rx[i];
+                sums.alignment.y += boids.ry[i];
+                sums.alignment.z += boids.rz[i];
+            }
+        }
+
+#ifdef SWARMULATOR_X86
+        __attribute__((target("avx2,fma"))) float hsum(const __m256 v) {
+            __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+            s = _mm_add_ss(s, _mm_movehdup_ps(s));
+            return _mm_cvtss_f32(s);
+        }
+
+        __attribute__((target("avx2,fma"))) size_t flock_avx2(const Vector3 &self, const float avoidance_radius, const neighbor_batch &boids, flock_sums &sums) {
+            const __m256 sx = _mm256_set1_ps(self.x), sy = _mm256_set1_ps(self.y), sz = _mm256_set1_ps(self.z);
+            const __m256 radius = _mm256_set1_ps(avoidance_radius);
+            const __m256 one = _mm256_set1_ps(1.f);
+            __m256 cx = _mm256_setzero_ps(), cy = _mm256_setzero_ps(), cz = _mm256_setzero_ps();
+            __m256 lx = _mm256_setzero_ps(), ly = _mm256_setzero_ps(), lz = _mm256_setzero_ps();
+            __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps(), az = _mm256_setzero_ps();
+
+            const size_t n = boids.size() / 8 * 8;
+            for (size_t i = 0; i < n; i += 8) {
+                const __m256 px = _mm256_loadu_ps(boids.x.data() + i);
+                const __m256 py = _mm256_loadu_ps(boids.y.data() + i);
+                const __m256 pz = _mm256_loadu_ps(boids.z.data() + i);
+                cx = _mm256_add_ps(cx, px);
+                cy = _mm256_add_ps(cy, py);
+                cz = _mm256_add_ps(cz, pz);
+                lx = _mm256_add_ps(lx, _mm256_loadu_ps(boids.rx.data() + i));
+                ly = _mm256_add_ps(ly, _mm256_loadu_ps(boids.ry.data() + i));
+                lz = _mm256_add_ps(lz, _mm256_loadu_ps(boids.rz.data() + i));
+
+                const __m256 dx = _mm256_sub_ps(sx, px);
+                const __m256 dy = _mm256_sub_ps(sy, py);
+                const __m256 dz = _mm256_sub_ps(sz, pz);
+                const __m256 d = _mm256_sqrt_ps(_mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz))));
+                // 1 / (1 + d) where d < radius, 0 everywhere else
+                const __m256 f = _mm256_and_ps(_mm256_cmp_ps(d, radius, _CMP_LT_OQ), _mm256_div_ps(one, _mm256_add_ps(one, d)));
+                ax = _mm256_fmadd_ps(dx, f, ax);
+                ay = _mm256_fmadd_ps(dy, f, ay);
+                az = _mm256_fmadd_ps(dz, f, az);
+            }
+
+            sums.cohesion = Vector3(hsum(cx), hsum(cy), hsum(cz));
+            sums.alignment = Vector3(hsum(lx), hsum(ly), hsum(lz));
+            sums.avoidance = Vector3(hsum(ax), hsum(ay), hsum(az));
+            return n;
+        }
+
+        // gcc 12 warns about an uninitialized '__Y' inside its own avx512 intrinsics (_mm512_reduce_add_ps and friends), a known false positive
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+        __attribute__((target("avx512f"))) size_t flock_avx512(const Vector3 &self, const float avoidance_radius, const neighbor_batch &boids, flock_sums &sums) {
+            const __m512 sx = _mm512_set1_ps(self.x), sy = _mm512_set1_ps(self.y), sz = _mm512_set1_ps(self.z);
+            const __m512 radius = _mm512_set1_ps(avoidance_radius);
+            const __m512 one = _mm512_set1_ps(1.f);
+            __m512 cx = _mm512_setzero_ps(), cy = _mm512_setzero_ps(), cz = _mm512_setzero_ps();
+            __m512 lx = _mm512_setzero_ps(), ly = _mm512_setzero_ps(), lz = _mm512_setzero_ps();
+            __m512 ax = _mm512_setzero_ps(), ay = _mm512_setzero_ps(), az = _mm512_setzero_ps();
+
+            // masked loads take care of the tail, so there is nothing left over for the scalar kernel
+            for (size_t i = 0; i < boids.size(); i += 16) {
+                const auto remaining = boids.size() - i;
+                const __mmask16 live = remaining >= 16 ? 0xffff : static_cast<__mmask16>((1u << remaining) - 1);
+                const __m512 px = _mm512_maskz_loadu_ps(live, boids.x.data() + i);
+                const __m512 py = _mm512_maskz_loadu_ps(live, boids.y.data() + i);
+                const __m512 pz = _mm512_maskz_loadu_ps(live, boids.z.data() + i);
+                cx = _mm512_add_ps(cx, px);
+                cy = _mm512_add_ps(cy, py);
+                cz = _mm512_add_ps(cz, pz);
+                lx = _mm512_add_ps(lx, _mm512_maskz_loadu_ps(live, boids.rx.data() + i));
+                ly = _mm512_add_ps(ly, _mm512_maskz_loadu_ps(live, boids.ry.data() + i));
+                lz = _mm512_add_ps(lz, _mm512_maskz_loadu_ps(live, boids.rz.data() + i));
+
+                const __m512 dx = _mm512_sub_ps(sx, px);
+                const __m512 dy = _mm512_sub_ps(sy, py);
+                const __m512 dz = _mm512_sub_ps(sz, pz);
+                const __m512 d = _mm512_sqrt_ps(_mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz))));
+                const __mmask16 close = _mm512_mask_cmp_ps_mask(live, d, radius, _CMP_LT_OQ);
+                const __m512 f = _mm512_maskz_div_ps(close, one, _mm512_add_ps(one, d));
+                ax = _mm512_fmadd_ps(dx, f, ax);
+                ay = _mm512_fmadd_ps(dy, f, ay);
+                az = _mm512_fmadd_ps(dz, f, az);
+            }
+
+            sums.cohesion = Vector3(_mm512_reduce_add_ps(cx), _mm512_reduce_add_ps(cy), _mm512_reduce_add_ps(cz));
+            sums.alignment = Vector3(_mm512_reduce_add_ps(lx), _mm512_reduce_add_ps(ly), _mm512_reduce_add_ps(lz));
+            sums.avoidance = Vector3(_mm512_reduce_add_ps(ax), _mm512_reduce_add_ps(ay), _mm512_reduce_add_ps(az));
+            return boids.size();
+        }
+#pragma GCC diagnostic pop
+#endif
+    }
+
+    isa best_isa() {
+#ifdef SWARMULATOR_X86
+        static const isa best = [] {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) return isa::avx512;
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return isa::avx2;
+            return isa::scalar;
+        }();
+        return best;
+#else
+        return isa::scalar;
+#endif
+    }
+
+    flock_sums flock(const Vector3 &self, const float avoidance_radius, const neighbor_batch &boids, const isa which) {
+        flock_sums sums{Vector3(0, 0, 0), Vector3(0, 0, 0), Vector3(0, 0, 0), static_cast<uint32_t>(boids.size())};
+        size_t done = 0;
+#ifdef SWARMULATOR_X86
+        // for less than a vector's worth of neighbors, setup and horizontal sums cost more than they save
+        if (const bool wide = boids.size() >= 8; wide && which == isa::avx512) {
+            done = flock_avx512(self, avoidance_radius, boids, sums);
+        }
+        else if (wide && which == isa::avx2) {
+            done = flock_avx2(self, avoidance_radius, boids, sums);
+        }
+#endif
+        flock_scalar(self, avoidance_radius, boids, done, sums);
+        return sums;
+    }
+
+    Vector3 avoid(const Vector3 &self, const float weight, const neighbor_batch &others) {
+        Vector3 avoidance = {0, 0, 0};
+        for (size_t i = 0; i < others.size(); i++) {
+            const float dx = self.x - others.x[i];
+            const float dy = self.y - others.y[i];
+            const float dz = self.z - others.z[i];
+            const float f = weight / (1.f + std::sqrt(dx * dx + dy * dy + dz * dz));
+            avoidance.x += dx * f;
+            avoidance.y += dy * f;
+            avoidance.z += dz * f;
+        }
+        return avoidance;
+    }
+} // namespace swarmulator::boid_kernel
@@ -0,0 +1,58 @@
+//
+// Created by moltma on 11/3/25.
+// vectorized flocking rules for boids
+// neighbors are gathered into flat arrays first, so the kernels can process 8 (avx2) or 16 (avx-512) of them at once
+// the best instruction set the cpu supports is picked at runtime, with a scalar fallback for everything else
+//
+
+#ifndef SWARMULATOR_CPP_BOIDKERNEL_H
+#define SWARMULATOR_CPP_BOIDKERNEL_H
+#include <cstdint>
+#include <vector>
+
+#include "raylib.h"
+
+namespace swarmulator::boid_kernel {
+    // neighbor state, structure of arrays
+    // keep one around per thread and clear it between boids, so gathering doesn't allocate
+    struct neighbor_batch {
+        std::vector<float> x{}, y{}, z{}; // positions
+        std::vector<float> rx{}, ry{}, rz{}; // headings
+
+        void clear() {
+            x.clear(); y.clear(); z.clear();
+            rx.clear(); ry.clear(); rz.clear();
+        }
+
+        void push(const Vector3 position, const Vector3 heading) {
+            x.push_back(position.x); y.push_back(position.y); z.push_back(position.z);
+            rx.push_back(heading.x); ry.push_back(heading.y); rz.push_back(heading.z);
+        }
+
+        [[nodiscard]] size_t size() const { return x.size(); }
+    };
+
+    // sums of the three flocking rules over a batch of neighbors
+    struct flock_sums {
+        Vector3 cohesion; // sum of neighbor positions
+        Vector3 alignment; // sum of neighbor headings
+        Vector3 avoidance; // sum of (self - neighbor) / (1 + distance), for neighbors closer than the avoidance radius
+        uint32_t count; // number of neighbors summed over
+    };
+
+    enum class isa { scalar, avx2, avx512 };
+
+    // the best instruction set this cpu supports (checked once)
+    [[nodiscard]] isa best_isa();
+
+    // flocking sums for a boid at self against a batch of other boids
+    // results from different instruction sets only differ by float summation order
+    // batches smaller than 8 always go through the scalar kernel
+    [[nodiscard]] flock_sums flock(const Vector3 &self, float avoidance_radius, const neighbor_batch &boids, isa which = best_isa());
+
+    // sum of weight * (self - p) / (1 + |self - p|) over a batch of positions to avoid at any distance
+    // scalar only, there are never many of these
+    [[nodiscard]] Vector3 avoid(const Vector3 &self, float weight, const neighbor_batch &others);
+} // namespace swarmulator::boid_kernel
+
+#endif // SWARMULATOR_CPP_BOIDKERNEL_H
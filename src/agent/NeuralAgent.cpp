@@ -4,79 +4,202 @@
 
 #include "NeuralAgent.h"
 
+#include <cstring>
+#include <omp.h>
+
 #include "../sim/util.h"
 #include "raymath.h"
 
 namespace swarmulator {
-    NeuralAgent::NeuralAgent() : SimObject() {
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    NeuralAgent<In, Hidden, Out>::NeuralAgent() : SimObject() {
         signals_.fill(0);
     }
 
-    NeuralAgent::NeuralAgent(const Vector3 position, const Vector3 rotation) : SimObject(position, rotation) {
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    NeuralAgent<In, Hidden, Out>::NeuralAgent(const Vector3 position, const Vector3 rotation) : SimObject(position, rotation) {
         signals_.fill(0);
+        auto rng = setup_stream(random_purpose::brain);
+        randomize_brain(rng);
     }
 
-    void NeuralAgent::think() {
-        // normalize input
-        input_.normalize();
-        // run the network
-        hidden_out_ = (input_ * w_in_hidden_ + hidden_out_ * context_weight_).unaryExpr(&sigmoid) + b_hidden_;
-        output_ = (hidden_out_ * w_hidden_out_).unaryExpr(&sigmoid);
-        // when you're done thinking, zero your input
-        input_.setZero();
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    NeuralAgent<In, Hidden, Out>::NeuralAgent(const Vector3 position, const Vector3 rotation, random_stream &rng) : SimObject(position, rotation) {
+        signals_.fill(0);
+        randomize_brain(rng);
+    }
+
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    void NeuralAgent<In, Hidden, Out>::randomize_brain(random_stream &rng) {
+        // the matrices are contiguous, so the stream can write them directly
+        const auto fill = [&rng](float* w, const size_t n) {
+            rng.fill_uniform(w, n);
+            for (size_t i = 0; i < n; i++) {
+                w[i] = w[i] * 2.f - 1.f;
+            }
+        };
+        fill(w_in_hidden_.data(), w_in_hidden_.size());
+        fill(w_hidden_out_.data(), w_hidden_out_.size());
+        fill(b_hidden_.data(), b_hidden_.size());
+    }
+
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    void NeuralAgent<In, Hidden, Out>::update(const Neighborhood &neighborhood, [[maybe_unused]] float dt) {
+        // if the neighbor is another neuralagent, add its signals to the input vector
+        neighborhood.for_each_neighbor<NeuralAgent>([&](const NeuralAgent &neighbor, const Vector3 &position) {
+            const auto dist_sqr = Vector3DistanceSqr(position_, position);
+            const float weight = 1.f / (1.f + dist_sqr); // neurals are weighted by their inverse distance squared
+            const auto neighbor_signals = neighbor.get_signals();
+            // absolute position difference relative to world axes
+            const auto [dx, dy, dz] = position - position_;
+            // magnitudes of differences tell us which cardinal segment the neighbor is in
+            if (std::abs(dx) > std::abs(dy) && std::abs(dx) > std::abs(dz)) {
+                if (dx > 0) {
+                    // neighbor is in front of us
+                    input_(0, 0) += weight * neighbor_signals[0];
+                    input_(0, 1) += weight * neighbor_signals[1];
+                }
+                else {
+                    // neighbor is behind us
+                    input_(0, 2) += weight * neighbor_signals[0];
+                    input_(0, 3) += weight * neighbor_signals[1];
+                }
+            }
+            else if (std::abs(dy) > std::abs(dx) && std::abs(dy) > std::abs(dz)) {
+                if (dy > 0) {
+                    // neighbor is above us
+                    input_(0, 4) += weight * neighbor_signals[0];
+                    input_(0, 5) += weight * neighbor_signals[1];
+                }
+                else {
+                    // neighbor is below us
+                    input_(0, 6) += weight * neighbor_signals[0];
+                    input_(0, 7) += weight * neighbor_signals[1];
+                }
+            }
+            else if (std::abs(dz) > std::abs(dx) && std::abs(dz) > std::abs(dy)) {
+                if (dz > 0) {
+                    // neighbor is left of us
+                    input_(0, 8) += weight * neighbor_signals[0];
+                    input_(0, 9) += weight * neighbor_signals[1];
+                }
+                else {
+                    // neighbor is right of us
+                    input_(0, 10) += weight * neighbor_signals[0];
+                    input_(0, 11) += weight * neighbor_signals[1];
+                }
+            }
+        });
+        // if you want to do other things with other objects, do them here (for_each_neighbor with their type)
     }
 
-    void NeuralAgent::update(const std::list<SimObject *> &neighborhood, float dt) {
-        for (const auto thing : neighborhood) {
-            if (const auto neighbor = dynamic_cast<NeuralAgent*>(thing); neighbor != nullptr) {
-                // if the neighbor is another neuralagent, add its signals to the input vector
-                const auto dist_sqr = Vector3DistanceSqr(position_, neighbor->get_position());
-                const float weight = 1.f / (1.f + dist_sqr); // neurals are weighted by their inverse distance squared
-                const auto neighbor_signals = neighbor->get_signals();
-                // absolute position difference relative to world axes
-                const auto [dx, dy, dz] = neighbor->get_position() - position_;
-                // magnitudes of differences tell us which cardinal segment the neighbor is in
-                if (std::abs(dx) > std::abs(dy) && std::abs(dx) > std::abs(dz)) {
-                    if (dx > 0) {
-                        // neighbor is in front of us
-                        input_(0, 0) += weight * neighbor_signals[0];
-                        input_(0, 1) += weight * neighbor_signals[1];
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    void NeuralAgent<In, Hidden, Out>::update_batch(std::vector<SimObject*> &agents, const float dt, std::vector<CommandBuffer> &commands) {
+        // agents per block, one simd lane each (16 floats fill an avx-512 register, or two avx2 ones)
+        static constexpr size_t lanes = 16;
+        // one block of agents, packed lane-interleaved: element [..][lane] belongs to agent lane of the block
+        // so every multiply-add of the network runs over the whole block at once, with each lane against its own agent's weights
+        struct alignas(64) block {
+            float input[In][lanes];
+            float context[Hidden][lanes]; // last hidden outputs, piped back in
+            float context_weight[lanes];
+            float w_in_hidden[In][Hidden][lanes];
+            float w_hidden_out[Hidden][Out][lanes];
+            float b_hidden[Hidden][lanes];
+            float hidden[Hidden][lanes];
+            float output[Out][lanes];
+        };
+
+        const size_t n = agents.size();
+        const size_t blocks = (n + lanes - 1) / lanes;
+
+#pragma omp parallel default(none) shared(agents, n, blocks, dt, commands)
+        {
+            block b; // per thread, on the stack (about 12 kB with the default shape)
+            auto& thread_commands = commands[omp_get_thread_num()];
+
+#pragma omp for schedule(static)
+            for (size_t k = 0; k < blocks; k++) {
+                const size_t first = k * lanes;
+                const size_t count = n - first < lanes ? n - first : lanes;
+                if (count < lanes) {
+                    std::memset(&b, 0, sizeof(b)); // unused lanes compute on zeros
+                }
+
+                // pack: normalized inputs, context and weights of every agent of the block into its lane
+                for (size_t l = 0; l < count; l++) {
+                    auto& agent = *static_cast<NeuralAgent*>(agents[first + l]);
+                    agent.input_.normalize();
+                    for (unsigned int i = 0; i < In; i++) {
+                        b.input[i][l] = agent.input_(0, i);
                     }
-                    else {
-                        // neighbor is behind us
-                        input_(0, 2) += weight * neighbor_signals[0];
-                        input_(0, 3) += weight * neighbor_signals[1];
+                    agent.input_.setZero(); // when you're done thinking, zero your input
+                    for (unsigned int h = 0; h < Hidden; h++) {
+                        b.context[h][l] = agent.hidden_out_(0, h);
+                        b.b_hidden[h][l] = agent.b_hidden_(0, h);
+                        for (unsigned int i = 0; i < In; i++) {
+                            b.w_in_hidden[i][h][l] = agent.w_in_hidden_(i, h);
+                        }
+                        for (unsigned int o = 0; o < Out; o++) {
+                            b.w_hidden_out[h][o][l] = agent.w_hidden_out_(h, o);
+                        }
                     }
+                    b.context_weight[l] = agent.context_weight_;
                 }
-                else if (std::abs(dy) > std::abs(dx) && std::abs(dy) > std::abs(dz)) {
-                    if (dy > 0) {
-                        // neighbor is above us
-                        input_(0, 4) += weight * neighbor_signals[0];
-                        input_(0, 5) += weight * neighbor_signals[1];
+
+                // hidden layer: context, plus inputs times weights, then activation and bias
+                for (unsigned int h = 0; h < Hidden; h++) {
+#pragma omp simd
+                    for (size_t l = 0; l < lanes; l++) {
+                        b.hidden[h][l] = b.context[h][l] * b.context_weight[l];
                     }
-                    else {
-                        // neighbor is below us
-                        input_(0, 6) += weight * neighbor_signals[0];
-                        input_(0, 7) += weight * neighbor_signals[1];
+                    for (unsigned int i = 0; i < In; i++) {
+#pragma omp simd
+                        for (size_t l = 0; l < lanes; l++) {
+                            b.hidden[h][l] += b.input[i][l] * b.w_in_hidden[i][h][l];
+                        }
+                    }
+#pragma omp simd
+                    for (size_t l = 0; l < lanes; l++) {
+                        b.hidden[h][l] = 1.f / (1.f + std::exp(-b.hidden[h][l])) + b.b_hidden[h][l];
                     }
                 }
-                else if (std::abs(dz) > std::abs(dx) && std::abs(dz) > std::abs(dy)) {
-                    if (dz > 0) {
-                        // neighbor is left of us
-                        input_(0, 8) += weight * neighbor_signals[0];
-                        input_(0, 9) += weight * neighbor_signals[1];
+
+                // output layer: hidden outputs times weights, then activation
+                for (unsigned int o = 0; o < Out; o++) {
+#pragma omp simd
+                    for (size_t l = 0; l < lanes; l++) {
+                        b.output[o][l] = 0;
+                    }
+                    for (unsigned int h = 0; h < Hidden; h++) {
+#pragma omp simd
+                        for (size_t l = 0; l < lanes; l++) {
+                            b.output[o][l] += b.hidden[h][l] * b.w_hidden_out[h][o][l];
+                        }
                     }
-                    else {
-                        // neighbor is right of us
-                        input_(0, 10) += weight * neighbor_signals[0];
-                        input_(0, 11) += weight * neighbor_signals[1];
+#pragma omp simd
+                    for (size_t l = 0; l < lanes; l++) {
+                        b.output[o][l] = 1.f / (1.f + std::exp(-b.output[o][l]));
                     }
                 }
+
+                // scatter the results back and act on them
+                for (size_t l = 0; l < count; l++) {
+                    auto& agent = *static_cast<NeuralAgent*>(agents[first + l]);
+                    for (unsigned int h = 0; h < Hidden; h++) {
+                        agent.hidden_out_(0, h) = b.hidden[h][l];
+                    }
+                    for (unsigned int o = 0; o < Out; o++) {
+                        agent.output_(0, o) = b.output[o][l];
+                    }
+                    agent.act(dt, thread_commands);
+                }
             }
-            // if you want to do other things with other objects, do them here
         }
-        // run the network
-        think();
+    }
+
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    void NeuralAgent<In, Hidden, Out>::act(const float dt, CommandBuffer &commands) {
         // network output is between 0 and 1, so scale between -1 and 1 and use that to choose an angle between 0 and 2pi to rotate by
         const float pitch = output_(0, 0) * 2.f * std::numbers::pi; // as in witkowski/ikegami - agents select an angle between 0 and 2pi to steer in
         const float yaw = output_(0, 1) * 2.f * std::numbers::pi; // no tiller steering! direct heading control!
@@ -93,48 +216,61 @@ namespace swarmulator {
         position_ = position_ + rotation_ * move_speed_ * dt;
         // update energy
         energy_ -= (signal_cost_ * (std::abs(signals_[0]) + std::abs(signals_[1])) + basic_cost_) * dt;
+        age_ += dt;
+
+        if (!life_cycle_) {
+            return;
+        }
+        // out of energy or too old, so die (removed at the end of the update)
+        if (energy_ <= 0 || age_ > max_lifetime_) {
+            deactivate();
+            return;
+        }
+        // enough energy to reproduce, so pay for it and spawn a mutated copy, which starts out young and with initial energy
+        if (energy_ >= reproduction_threshold_) {
+            energy_ -= reproduction_cost_;
+            auto child = mutate();
+            child.energy_ = initial_energy_;
+            child.age_ = 0;
+            commands.spawn(id_, child);
+        }
     }
 
-    NeuralAgent NeuralAgent::mutate(const float mutation_chance) {
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    NeuralAgent<In, Hidden, Out> NeuralAgent<In, Hidden, Out>::mutate(random_stream &rng, const float mutation_chance) {
         auto copy = NeuralAgent(*this);
+        copy.offspring_ = 0;
 
-        for (int i = 0; i < copy.num_hidden_; i++) {
-            for (int j = 0; j < copy.num_inputs_; j++) {
-                copy.w_in_hidden_(j, i) += randfloat() < mutation_chance ? randfloat() * 2.f - 1.f : 0;
-            }
-            for (int k = 0; k < copy.num_outputs_; k++) {
-                copy.w_hidden_out_(i, k) += randfloat() < mutation_chance ? randfloat() * 2.f - 1.f : 0;
+        // two numbers per weight (whether it mutates, and by how much), drawn all at once
+        // then a branch-free pass over every weight matrix, which are all contiguous
+        constexpr size_t weights = In * Hidden + Hidden * Out + Hidden;
+        std::array<float, 2 * weights> draws;
+        rng.fill_uniform(draws.data(), draws.size());
+        const float* chance = draws.data();
+        const float* delta = draws.data() + weights;
+        const auto apply = [&](float* w, const size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                w[i] += chance[i] < mutation_chance ? delta[i] * 2.f - 1.f : 0.f;
             }
-            copy.b_hidden_(0, i) += randfloat() < mutation_chance ? 0 : randfloat() * 2.f - 1.f;
-        }
+            chance += n;
+            delta += n;
+        };
+        apply(copy.w_in_hidden_.data(), copy.w_in_hidden_.size());
+        apply(copy.w_hidden_out_.data(), copy.w_hidden_out_.size());
+        apply(copy.b_hidden_.data(), copy.b_hidden_.size());
 
         return copy;
     }
 
-    SimObject::SSBOObject NeuralAgent::to_ssbo() const {
-        SSBOObject out;
-        out.position.w = 0;
-        out.position.x = position_.x;
-        out.position.y = position_.y;
-        out.position.z = position_.z;
-
-        out.rotation.w = 0;
-        out.rotation.x = rotation_.x;
-        out.rotation.y = rotation_.y;
-        out.rotation.z = rotation_.z;
-
-        out.info.w = 0;
-        out.info.x = signals_[0];
-        out.info.y = signals_[1];
-        out.info.z = 0;
-
-        out.scale = Vector4(1, 1, 1, 1);
-
-        return out;
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    NeuralAgent<In, Hidden, Out> NeuralAgent<In, Hidden, Out>::mutate(const float mutation_chance) {
+        random_stream rng(id_, offspring_++, random_purpose::mutation);
+        return mutate(rng, mutation_chance);
     }
 
-    std::vector<float> NeuralAgent::log() const {
-        std::vector out = {
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    void NeuralAgent<In, Hidden, Out>::log_row(std::vector<float> &row) const {
+        row.insert(row.end(), {
             static_cast<float>(id_),
             position_.x,
             position_.y,
@@ -142,28 +278,72 @@ namespace swarmulator {
             rotation_.x,
             rotation_.y,
             rotation_.z,
-        };
+            signals_[0],
+            signals_[1],
+        });
+    }
 
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    void NeuralAgent<In, Hidden, Out>::genome_row(std::vector<float> &row) const {
         // weight matrices are flattened column-major
         // a b
         // c d
         // becomes a c b d
         // push back in-hidden weights
-        const float* flat = w_in_hidden_.data();
-        for (int i = 0; i < w_in_hidden_.size(); i++) {
-            out.push_back(flat[i]);
-        }
+        row.insert(row.end(), w_in_hidden_.data(), w_in_hidden_.data() + w_in_hidden_.size());
         // push back hidden-out weights
-        flat = w_hidden_out_.data();
-        for (int i = 0; i < w_hidden_out_.size(); i++) {
-            out.push_back(flat[i]);
-        }
+        row.insert(row.end(), w_hidden_out_.data(), w_hidden_out_.data() + w_hidden_out_.size());
         // push back biases
-        flat = b_hidden_.data();
-        for (int i = 0; i < b_hidden_.size(); i++) {
-            out.push_back(flat[i]);
-        }
+        row.insert(row.end(), b_hidden_.data(), b_hidden_.data() + b_hidden_.size());
+    }
+
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    void NeuralAgent<In, Hidden, Out>::save_state(state_writer &out) const {
+        SimObject::save_state(out);
+        out.put(signals_);
+        out.put(front_signals_);
+        // inputs are zeroed after every think, so between updates only the context (last hidden output) carries over
+        out.put(hidden_out_.data(), hidden_out_.size());
+        out.put(output_.data(), output_.size());
+        out.put(w_in_hidden_.data(), w_in_hidden_.size());
+        out.put(w_hidden_out_.data(), w_hidden_out_.size());
+        out.put(b_hidden_.data(), b_hidden_.size());
+        out.put(context_weight_);
+        out.put(energy_);
+        out.put(reproduction_threshold_);
+        out.put(reproduction_cost_);
+        out.put(signal_cost_);
+        out.put(basic_cost_);
+        out.put(move_speed_);
+        out.put(max_lifetime_);
+        out.put(offspring_);
+        out.put(age_);
+        out.put(life_cycle_);
+    }
 
-        return out;
+    template<unsigned int In, unsigned int Hidden, unsigned int Out>
+    void NeuralAgent<In, Hidden, Out>::restore_state(state_reader &in) {
+        SimObject::restore_state(in);
+        in.get(signals_);
+        in.get(front_signals_);
+        input_.setZero();
+        in.get(hidden_out_.data(), hidden_out_.size());
+        in.get(output_.data(), output_.size());
+        in.get(w_in_hidden_.data(), w_in_hidden_.size());
+        in.get(w_hidden_out_.data(), w_hidden_out_.size());
+        in.get(b_hidden_.data(), b_hidden_.size());
+        in.get(context_weight_);
+        in.get(energy_);
+        in.get(reproduction_threshold_);
+        in.get(reproduction_cost_);
+        in.get(signal_cost_);
+        in.get(basic_cost_);
+        in.get(move_speed_);
+        in.get(max_lifetime_);
+        in.get(offspring_);
+        in.get(age_);
+        in.get(life_cycle_);
     }
+
+    template class NeuralAgent<>;
 } // namespace swarmulator
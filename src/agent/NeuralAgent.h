@@ -5,32 +5,45 @@
 #ifndef SWARMULATOR_CPP_NEURALAGENT_H
 #define SWARMULATOR_CPP_NEURALAGENT_H
 #include <array>
+#include <vector>
 #include <eigen3/Eigen/Eigen>
 
+#include "../sim/CommandBuffer.h"
+#include "../sim/Random.h"
 #include "../sim/SimObject.h"
 
 namespace swarmulator {
 
+    // brain shape is a compile time parameter, so all brain matrices are fixed-size and live inline in the agent
+    // (no heap allocations per agent, copies are plain memory copies, and eigen can unroll the products)
+    // sensing fills 12 inputs (2 signals from each of 6 directions) and acting reads 4 outputs, so those are the minimum shapes
+    // shapes other than the default need an explicit instantiation in NeuralAgent.cpp
+    template<unsigned int In = 12, unsigned int Hidden = 10, unsigned int Out = 5>
     class NeuralAgent : public SimObject {
+        static_assert(In == 12, "NeuralAgent senses exactly 12 inputs");
+        static_assert(Out >= 4, "NeuralAgent needs at least 4 outputs to act on");
+
     protected:
         // brain shape
-        static constexpr unsigned int num_inputs_ = 12;
-        static constexpr unsigned int num_hidden_ = 10;
-        static constexpr unsigned int num_outputs_ = 5;
+        static constexpr unsigned int num_inputs_ = In;
+        static constexpr unsigned int num_hidden_ = Hidden;
+        static constexpr unsigned int num_outputs_ = Out;
 
         // signal output array
         std::array<float, 2> signals_ = {0, 0};
+        // signals as seen by neighbors (front buffer, see SimObject)
+        std::array<float, 2> front_signals_ = {0, 0};
 
         // brain matrices
         // zeroed brain
-        Eigen::MatrixXf input_ = Eigen::MatrixXf::Zero(1, num_inputs_); // network input
-        Eigen::MatrixXf hidden_out_ = Eigen::MatrixXf::Zero(1, num_hidden_); // output of hidden layer (after activation)
-        Eigen::MatrixXf output_ = Eigen::MatrixXf::Zero(1, num_outputs_); // network output (after activation)
-        // random weights
-        Eigen::MatrixXf w_in_hidden_ = Eigen::MatrixXf::Random(num_inputs_, num_hidden_); // weights from input to hidden
-        Eigen::MatrixXf w_hidden_out_ = Eigen::MatrixXf::Random(num_hidden_, num_outputs_); // weights from hidden to out
-        // random biases on hidden layer
-        Eigen::MatrixXf b_hidden_ = Eigen::MatrixXf::Random(1, num_hidden_);
+        Eigen::Matrix<float, 1, In> input_ = Eigen::Matrix<float, 1, In>::Zero(); // network input
+        Eigen::Matrix<float, 1, Hidden> hidden_out_ = Eigen::Matrix<float, 1, Hidden>::Zero(); // output of hidden layer (after activation)
+        Eigen::Matrix<float, 1, Out> output_ = Eigen::Matrix<float, 1, Out>::Zero(); // network output (after activation)
+        // weights, random between -1 and 1 for new agents (see randomize_brain), zero for default constructed ones
+        Eigen::Matrix<float, In, Hidden> w_in_hidden_ = Eigen::Matrix<float, In, Hidden>::Zero(); // weights from input to hidden
+        Eigen::Matrix<float, Hidden, Out> w_hidden_out_ = Eigen::Matrix<float, Hidden, Out>::Zero(); // weights from hidden to out
+        // biases on hidden layer
+        Eigen::Matrix<float, 1, Hidden> b_hidden_ = Eigen::Matrix<float, 1, Hidden>::Zero();
         float context_weight_ = 0.5; // weight of context layer (strength with which old hidden layer outputs are piped back in at next runthrough) (should probably not be greater than 1)
 
         // other params
@@ -43,10 +56,18 @@ namespace swarmulator {
         float move_speed_ = 5; // how many units space you move per unit time
 
         float max_lifetime_ = 5000; // how many unit time this agent may be alive for at most
+        float age_ = 0; // how many unit time this agent has been alive for
+        // whether this agent dies (out of energy, or older than max_lifetime) and reproduces (energy over the reproduction threshold)
+        // off by default: nothing in the model gains energy yet, so every population would just die out
+        bool life_cycle_ = false;
+        uint32_t offspring_ = 0; // how many mutated copies this agent has made, counts its mutation streams
+
+        // fill the brain with random weights and biases between -1 and 1
+        void randomize_brain(random_stream &rng);
 
-        // run input through the brain and set outputs
-        // zero input when done
-        void think();
+        // act on the network outputs: steer, signal, move, and pay for it
+        // then, with the life cycle on, die of starvation or old age, or reproduce if there is energy to spare (spawning through commands)
+        void act(float dt, CommandBuffer &commands);
 
         // several activation functions
         static inline constexpr float tanh(const float x) {
@@ -61,23 +82,65 @@ namespace swarmulator {
         }
 
     public:
+        // empty brain, for restoring agents into
         NeuralAgent();
+        // random brain from the setup stream
         NeuralAgent(Vector3 position, Vector3 rotation);
+        // random brain from the given stream
+        NeuralAgent(Vector3 position, Vector3 rotation, random_stream &rng);
         ~NeuralAgent() override = default;
 
-        [[nodiscard]] auto get_signals() const { return signals_; }
+        [[nodiscard]] auto get_signals() const { return front_signals_; }
+
+        // turn dying and reproducing on or off (offspring inherit the setting)
+        void set_life_cycle(const bool life_cycle) { life_cycle_ = life_cycle; }
+        [[nodiscard]] bool life_cycle() const { return life_cycle_; }
 
-        void update(const std::list<SimObject *> &neighborhood, float dt) override;
+        // sense: gather neighbor signals into the network input
+        // thinking and acting happen in update_batch, once every agent in the group has sensed
+        void update(const Neighborhood &neighborhood, float dt) override;
+
+        // group-wide update stage, run after every agent in the group was updated
+        // packs blocks of 16 agents lane-interleaved (inputs, context and each agent's own weights), runs the network as
+        // matrix products over the whole block at once (one simd lane per agent), scatters the outputs back and lets every agent act on them
+        // offspring go into the command buffer of the thread that got the parent
+        static void update_batch(std::vector<SimObject*> &agents, float dt, std::vector<CommandBuffer> &commands);
+
+        void swap_state() override {
+            SimObject::swap_state();
+            front_signals_ = signals_;
+        }
 
         // returns a mutated copy of this agent
-        NeuralAgent mutate(float mutation_chance = 0.05); // mutation chance is the probability each brain weight or bias gets a random value between -1 and 1 added
+        // mutation chance is the probability each brain weight or bias gets a random value between -1 and 1 added
+        NeuralAgent mutate(random_stream &rng, float mutation_chance = 0.05);
+        // the same, drawing from this agent's own mutation stream (keyed by its id and how many offspring it has had)
+        // so the result doesn't depend on which thread mutates which agent when
+        NeuralAgent mutate(float mutation_chance = 0.05);
 
-        [[nodiscard]] SSBOObject to_ssbo() const override;
+        // signals go to the shader
+        [[nodiscard]] Vector4 ssbo_info() const override { return Vector4(signals_[0], signals_[1], 0, 0); }
 
         [[nodiscard]] std::string type_name() const override { return "NeuralAgent"; };
-        [[nodiscard]] std::vector<float> log() const override;
+        // kinematic state and signals
+        void log_row(std::vector<float> &row) const override;
+        // signals are network outputs, so between 0 and 1
+        [[nodiscard]] std::vector<log_range> log_ranges(const Vector3 &world_size) const override {
+            auto ranges = SimObject::log_ranges(world_size);
+            ranges.push_back({7, 0, 1});
+            ranges.push_back({8, 0, 1});
+            return ranges;
+        }
+        // brain weights and biases, which only change at birth (mutate)
+        void genome_row(std::vector<float> &row) const override;
+
+        // brain (weights, biases and the recurrent context), signals, energy and age
+        void save_state(state_writer &out) const override;
+        void restore_state(state_reader &in) override;
     };
 
+    extern template class NeuralAgent<>;
+
 } // namespace swarmulator
 
 #endif // SWARMULATOR_CPP_NEURALAGENT_H
@@ -0,0 +1,95 @@
+//
+// Created by moltma on 11/3/25.
+// benchmark for the boid flocking kernels
+// runs every kernel the cpu supports over random neighbor batches of different sizes,
+// checks them against the scalar kernel, and reports time per boid and speedup
+//
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "../agent/BoidKernel.h"
+#include "../sim/util.h"
+
+namespace {
+    using namespace swarmulator::boid_kernel;
+
+    constexpr float radius = 10;
+
+    // largest relative difference between two sets of sums, over all components
+    float max_rel_error(const flock_sums &a, const flock_sums &b) {
+        float err = 0;
+        const auto cmp = [&](const Vector3 &u, const Vector3 &v) {
+            for (const auto& [x, y] : {std::pair{u.x, v.x}, std::pair{u.y, v.y}, std::pair{u.z, v.z}}) {
+                err = std::max(err, std::abs(x - y) / std::max(1.f, std::abs(y)));
+            }
+        };
+        cmp(a.cohesion, b.cohesion);
+        cmp(a.alignment, b.alignment);
+        cmp(a.avoidance, b.avoidance);
+        return err;
+    }
+
+    // average time for one boid's flocking sums in nanoseconds
+    double time_ns(const std::vector<Vector3> &selves, const neighbor_batch &boids, const isa which, const int reps) {
+        float sink = 0; // keep the compiler from throwing the work away
+        const auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; r++) {
+            for (const auto &self : selves) {
+                sink += flock(self, radius / 2.f, boids, which).avoidance.x;
+            }
+        }
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        if (sink == 12345.f) std::cout << sink << std::endl;
+        return elapsed.count() / (static_cast<double>(reps) * selves.size());
+    }
+
+    std::string isa_name(const isa which) {
+        switch (which) {
+            case isa::avx512: return "avx512";
+            case isa::avx2: return "avx2";
+            default: return "scalar";
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int reps = 200;
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "-r")) {
+        reps = std::stoi(o);
+    }
+
+    std::vector<isa> kernels = {isa::scalar};
+    if (best_isa() == isa::avx2 || best_isa() == isa::avx512) kernels.push_back(isa::avx2);
+    if (best_isa() == isa::avx512) kernels.push_back(isa::avx512);
+
+    swarmulator::set_random_seed(0);
+    std::vector<Vector3> selves(1000);
+    for (auto &self : selves) {
+        self = Vector3((swarmulator::randfloat() - 0.5f) * 2 * radius, (swarmulator::randfloat() - 0.5f) * 2 * radius, (swarmulator::randfloat() - 0.5f) * 2 * radius);
+    }
+
+    std::cout << "best kernel: " << isa_name(best_isa()) << ", repetitions: " << reps << std::endl;
+    std::cout << "neighbors\tkernel\tns/boid\tspeedup\tmax rel error" << std::endl;
+    for (const size_t n : {4, 16, 64, 256, 1024}) {
+        neighbor_batch boids;
+        for (size_t i = 0; i < n; i++) {
+            boids.push(Vector3((swarmulator::randfloat() - 0.5f) * 2 * radius, (swarmulator::randfloat() - 0.5f) * 2 * radius, (swarmulator::randfloat() - 0.5f) * 2 * radius),
+                       Vector3(swarmulator::randfloat() - 0.5f, swarmulator::randfloat() - 0.5f, swarmulator::randfloat() - 0.5f));
+        }
+
+        const double scalar_ns = time_ns(selves, boids, isa::scalar, reps);
+        for (const auto which : kernels) {
+            const double ns = which == isa::scalar ? scalar_ns : time_ns(selves, boids, which, reps);
+            float err = 0;
+            for (const auto &self : selves) {
+                err = std::max(err, max_rel_error(flock(self, radius / 2.f, boids, which), flock(self, radius / 2.f, boids, isa::scalar)));
+            }
+            std::cout << n << "\t" << isa_name(which) << "\t" << ns << "\t" << scalar_ns / ns << "x\t" << err << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+//
+// Created by moltma on 10/31/25.
+// benchmark for StaticGrid::sort_objects
+// times the parallel counting sort against the serial sort it replaced, on headless instancers of 10k to 1M boids
+//
+
+#include <chrono>
+#include <iostream>
+#include <omp.h>
+#include <string>
+
+#include "../agent/Boid.h"
+#include "../sim/ObjectInstancer.h"
+#include "../sim/StaticGrid.h"
+#include "../sim/util.h"
+
+namespace {
+    constexpr Vector3 world_size = {150, 150, 150};
+    constexpr int subdivisions = 20;
+
+    // the serial counting sort StaticGrid used to do, kept here as the baseline
+    // reallocates its buffers every call and walks every object list twice
+    struct serial_sort {
+        std::vector<swarmulator::SimObject*> sorted;
+        std::vector<uint32_t> segment_start;
+        std::vector<uint32_t> segment_length;
+
+        static int cell_index(const Vector3 pos_grid) {
+            if (pos_grid.x < 0 || pos_grid.y < 0 || pos_grid.z < 0 || pos_grid.x >= world_size.x || pos_grid.y >= world_size.y || pos_grid.z >= world_size.z) {
+                return -1;
+            }
+            const auto [x, y, z] = swarmulator::floorv3(pos_grid / (world_size / static_cast<float>(subdivisions)));
+            return subdivisions * subdivisions * static_cast<int>(x) + subdivisions * static_cast<int>(y) + static_cast<int>(z);
+        }
+
+        void operator()(swarmulator::ObjectInstancer &in) {
+            constexpr int total_cell_count = subdivisions * subdivisions * subdivisions;
+            sorted = std::vector<swarmulator::SimObject*>(in.size());
+            segment_start = std::vector<uint32_t>(total_cell_count, 0);
+            segment_length = std::vector<uint32_t>(total_cell_count, 0);
+
+            for (auto grp = in.begin(); grp != in.end(); ++grp) {
+                for (const auto obj_ptr : grp->second.objects) {
+                    if (const auto cell = cell_index(obj_ptr->get_position() + world_size * 0.5f); cell != -1) {
+                        ++segment_start[cell];
+                        ++segment_length[cell];
+                    }
+                }
+            }
+            for (int i = 1; i < total_cell_count; i++) {
+                segment_start[i] += segment_start[i - 1];
+            }
+            for (auto rgrp = in.rbegin(); rgrp != in.rend(); ++rgrp) {
+                for (auto rit = rgrp->second.objects.rbegin(); rit != rgrp->second.objects.rend(); ++rit) {
+                    if (const auto cell = cell_index((*rit)->get_position() + world_size * 0.5f); cell != -1) {
+                        sorted[--segment_start[cell]] = *rit;
+                    }
+                }
+            }
+        }
+    };
+
+    // average wall time of a sort over some repetitions, in milliseconds
+    template<class F>
+    double time_ms(F&& sort, const int reps) {
+        sort(); // warm up (and let the persistent buffers grow)
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; i++) {
+            sort();
+        }
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / reps;
+    }
+}
+
+int main(int argc, char** argv) {
+    int reps = 10;
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "-r")) {
+        reps = std::stoi(o);
+    }
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "-t")) {
+        omp_set_num_threads(std::stoi(o));
+    }
+
+    swarmulator::set_random_seed(0);
+    std::cout << "threads: " << omp_get_max_threads() << ", repetitions: " << reps << std::endl;
+    std::cout << "objects\tserial ms\tparallel ms\tspeedup" << std::endl;
+    for (const size_t n : {10'000, 100'000, 1'000'000}) {
+        swarmulator::ObjectInstancer instancer(true);
+        instancer.new_group<swarmulator::Boid>({}, "", "");
+        for (size_t i = 0; i < n; i++) {
+            const auto p = Vector3{(swarmulator::randfloat() - 0.5f) * world_size.x, (swarmulator::randfloat() - 0.5f) * world_size.y, (swarmulator::randfloat() - 0.5f) * world_size.z};
+            instancer.add_object(swarmulator::Boid(p, Vector3Zeros));
+        }
+
+        serial_sort serial;
+        swarmulator::StaticGrid grid(world_size, subdivisions);
+        const double serial_ms = time_ms([&] { serial(instancer); }, reps);
+        const double parallel_ms = time_ms([&] { grid.sort_objects(instancer); }, reps);
+        std::cout << n << "\t" << serial_ms << "\t" << parallel_ms << "\t" << serial_ms / parallel_ms << "x" << std::endl;
+    }
+
+    return 0;
+}
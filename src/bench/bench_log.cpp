@@ -0,0 +1,148 @@
+//
+// Created by moltma on 11/7/25.
+// benchmark for the logger's hdf5 layout and filter settings
+// records a headless boids run into memory once, then replays it through the logger with different log_options
+// reports write throughput (of the uncompressed data) and compression ratio for each, so settings can be picked per experiment
+//
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "../agent/Boid.h"
+#include "../sim/Simulation.h"
+#include "../sim/util.h"
+
+namespace {
+    constexpr Vector3 world_size = {150, 150, 150};
+    constexpr int subdivisions = 20;
+
+    // a headless boids simulation that keeps every frame's boid log rows instead of writing them
+    class recorder final : public swarmulator::Simulation {
+    public:
+        std::vector<std::vector<float>> frames{};
+        size_t width = 0;
+
+        explicit recorder(const int boids) : Simulation(world_size, subdivisions) {
+            const auto tri = std::vector<Vector3>{{0, 0, 0}};
+            new_object_type<swarmulator::Boid>(tri, "", "");
+            new_object_type<swarmulator::BoidEffector>(tri, "", "");
+            for (int i = 0; i < boids; i++) {
+                add_object(swarmulator::Boid(random_position(), Vector3(swarmulator::randfloat() - 0.5f, swarmulator::randfloat() - 0.5f, swarmulator::randfloat() - 0.5f)));
+            }
+            for (int i = 0; i < 50; i++) {
+                add_object(swarmulator::BoidEffector(random_position(), Vector3(0, 0, 0)));
+            }
+            width = swarmulator::Boid().log().size();
+        }
+
+        void record(const int steps, const float dt) {
+            for (int s = 0; s < steps; s++) {
+                update(dt, false);
+                auto& rows = frames.emplace_back();
+                for (auto grp = object_instancer_.begin(); grp != object_instancer_.end(); ++grp) {
+                    if (grp->second.type != swarmulator::type_id<swarmulator::Boid>()) {
+                        continue;
+                    }
+                    for (const auto obj : grp->second.objects) {
+                        obj->log_row(rows);
+                    }
+                }
+            }
+        }
+
+    private:
+        static Vector3 random_position() {
+            return Vector3((swarmulator::randfloat() - 0.5f) * world_size.x, (swarmulator::randfloat() - 0.5f) * world_size.y, (swarmulator::randfloat() - 0.5f) * world_size.z);
+        }
+    };
+
+    struct result {
+        double seconds;
+        double raw_mb;
+        double file_mb;
+    };
+
+    // write all recorded frames through a logger with the given options, and time it until the worker is done
+    result replay(const recorder &rec, const swarmulator::log_options &options, const std::string &path) {
+        const auto type = swarmulator::type_id<swarmulator::Boid>();
+        size_t raw_bytes = 0;
+        const auto start = std::chrono::steady_clock::now();
+        {
+            swarmulator::Logger logger;
+            logger.initialize(path, options, rec.frames.size(), 1, 1);
+            logger.create_object_group(type, "Boid", rec.width, 1, 0, swarmulator::Boid().log_ranges(world_size));
+            logger.prepare_staging(1);
+            for (size_t f = 0; f < rec.frames.size(); f++) {
+                logger.queue_begin_frame(static_cast<float>(f));
+                logger.queue_log_sim_data({static_cast<float>(f)}, true);
+                auto& rows = logger.staging_buffer(0, type);
+                rows.insert(rows.end(), rec.frames[f].begin(), rec.frames[f].end());
+                raw_bytes += rec.frames[f].size() * sizeof(float);
+                logger.queue_advance_frame();
+            }
+        } // logger destructor waits for everything to be written
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const auto file_bytes = std::filesystem::file_size(path);
+        std::filesystem::remove(path);
+        return {elapsed.count(), static_cast<double>(raw_bytes) / (1 << 20), static_cast<double>(file_bytes) / (1 << 20)};
+    }
+}
+
+int main(int argc, char** argv) {
+    int boids = 10000;
+    int steps = 300;
+    std::string path = "bench_log.h5";
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "-n")) {
+        boids = std::stoi(o);
+    }
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "-s")) {
+        steps = std::stoi(o);
+    }
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "-o")) {
+        path = o;
+    }
+
+    swarmulator::set_random_seed(42);
+    recorder rec(boids);
+    std::cout << "Recording " << steps << " steps of " << boids << " boids..." << std::endl;
+    rec.record(steps, 1.f / 60.f);
+
+    // the settings to compare
+    const auto make = [](const int digits, const bool shuffle, const size_t deflate, const size_t chunk_rows, const bool quantize = false) {
+        swarmulator::log_options o;
+        o.quantize = quantize;
+        o.scale_offset_digits = digits;
+        o.shuffle = shuffle;
+        o.deflate_level = deflate;
+        o.chunk_rows = chunk_rows;
+        return o;
+    };
+    const std::vector<std::pair<std::string, swarmulator::log_options>> configs = {
+        {"no filters", make(-1, false, 0, 1024)},
+        {"deflate 1", make(-1, false, 1, 1024)},
+        {"shuffle + deflate 1", make(-1, true, 1, 1024)},
+        {"shuffle + deflate 4", make(-1, true, 4, 1024)},
+        {"shuffle + deflate 9", make(-1, true, 9, 1024)},
+        {"shuffle + deflate 1, 256 rows", make(-1, true, 1, 256)},
+        {"shuffle + deflate 1, 8192 rows", make(-1, true, 1, 8192)},
+        {"scale-offset 3 (lossy)", make(3, false, 0, 1024)},
+        {"scale-offset 3 + shuffle + deflate 1", make(3, true, 1, 1024)},
+        {"16 bit positions/headings (lossy)", make(-1, false, 0, 1024, true)},
+        {"16 bit + shuffle + deflate 1", make(-1, true, 1, 1024, true)},
+    };
+
+    std::vector<std::pair<std::string, result>> results;
+    for (const auto& [name, options] : configs) {
+        results.emplace_back(name, replay(rec, options, path));
+    }
+
+    std::printf("\n%-40s %10s %10s %10s %8s\n", "settings", "raw MB", "file MB", "MB/s", "ratio");
+    for (const auto& [name, r] : results) {
+        std::printf("%-40s %10.1f %10.1f %10.1f %8.2f\n", name.c_str(), r.raw_mb, r.file_mb, r.raw_mb / r.seconds, r.raw_mb / r.file_mb);
+    }
+
+    return 0;
+}
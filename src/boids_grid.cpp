@@ -20,6 +20,8 @@ int main(int argc, char** argv) {
     int window_h = 720;
     constexpr Vector3 world_size = {150, 150, 150};
     constexpr int subdivisions = 20;
+    double run_for = 0;
+    double time_step = 0;
 
     if (const auto o = swarmulator::get_opt(argv, argv + argc, "-n")) {
         init_agent_count = std::stoi(o);
@@ -36,6 +38,52 @@ int main(int argc, char** argv) {
     if (const auto o = swarmulator::get_opt(argv, argv + argc, "-p")) {
         omp_set_num_threads(std::max(1, std::min(std::stoi(o), omp_get_max_threads()))); // number of threads used should not be greater than the maximum threads available on device
     }
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "-r")) {
+        run_for = std::stod(o);
+    }
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "-dt")) {
+        time_step = std::stod(o);
+    }
+    size_t reorder_interval = 0;
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "--reorder")) {
+        reorder_interval = std::stoul(o);
+    }
+    // logging: where to, how often (in updates), and how hard to compress
+    const char* log_path = swarmulator::get_opt(argv, argv + argc, "--log");
+    size_t log_every = 1;
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "--log-every")) {
+        log_every = std::stoul(o);
+    }
+    size_t log_deflate = 1;
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "--log-deflate")) {
+        log_deflate = std::stoul(o);
+    }
+    // how many MB of log data may pile up before the logger pushes back, and how (block, drop or degrade)
+    size_t log_budget_mb = 0;
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "--log-budget")) {
+        log_budget_mb = std::stoul(o);
+    }
+    auto log_policy = swarmulator::log_budget_policy::block;
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "--log-policy")) {
+        if (const std::string policy = o; policy == "drop") {
+            log_policy = swarmulator::log_budget_policy::drop_frames;
+        }
+        else if (policy == "degrade") {
+            log_policy = swarmulator::log_budget_policy::degrade;
+        }
+        else if (policy != "block") {
+            std::cerr << "Unknown log policy " << policy << " (block, drop or degrade)." << std::endl;
+            return 1;
+        }
+    }
+    // checkpoints: where to, how often (in updates), and where to restart from
+    const char* checkpoint_path = swarmulator::get_opt(argv, argv + argc, "--checkpoint");
+    size_t checkpoint_every = 0;
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "--checkpoint-every")) {
+        checkpoint_every = std::stoul(o);
+    }
+    const char* restore_path = swarmulator::get_opt(argv, argv + argc, "--restore");
+    const bool headless = swarmulator::opt_exists(argv, argv + argc, "--headless");
     if (swarmulator::opt_exists(argv, argv + argc, "--vsync")) {
         SetConfigFlags(FLAG_VSYNC_HINT);
     }
@@ -43,12 +91,49 @@ int main(int argc, char** argv) {
         SetConfigFlags(FLAG_MSAA_4X_HINT);
     }
 
-    // seed rng
-    auto s = time(nullptr);
-    srand(s);
+    // seed rng (restarts get theirs from the checkpoint)
+    uint64_t s = time(nullptr);
+    if (const auto o = swarmulator::get_opt(argv, argv + argc, "--seed")) {
+        s = std::stoull(o);
+    }
+    swarmulator::set_random_seed(s);
     std::cout << "Random seed: " << s << std::endl;
 
-    auto simulation = swarmulator::Simulation(window_w, window_h, world_size, subdivisions);
+    // headless runs have no frame time, so fall back on a fixed step if none was given
+    if (headless && time_step == 0) {
+        time_step = 1.0 / 60.0;
+    }
+
+    auto simulation = headless ? swarmulator::Simulation(world_size, subdivisions) : swarmulator::Simulation(window_w, window_h, world_size, subdivisions);
+    simulation.set_run_for(run_for);
+    simulation.set_time_step(time_step);
+    simulation.set_reorder_interval(reorder_interval);
+
+    // the log file is sized up front, so logging needs a known number of fixed updates
+    if (log_path != nullptr) {
+        if (run_for == 0 || time_step == 0) {
+            std::cerr << "Logging needs a run length (-r) and a fixed time step (-dt)." << std::endl;
+            return 1;
+        }
+        simulation.set_log_cadence({.every_steps = log_every});
+        simulation.set_log_cadence<swarmulator::BoidEffector>({.every_steps = 0, .once = true}); // effectors never move
+        swarmulator::log_options log_options;
+        log_options.shuffle = true;
+        log_options.deflate_level = log_deflate;
+        log_options.max_buffered_bytes = log_budget_mb << 20;
+        log_options.budget_policy = log_policy;
+        const auto steps = static_cast<size_t>(std::ceil(run_for / time_step)) + 1; // + 1 for float error in the sim clock
+        // restarts keep appending to the log of the run they pick up from
+        if (restore_path != nullptr) {
+            simulation.resume_logging(log_path, log_options);
+        }
+        else {
+            simulation.enable_logging(log_path, log_options, simulation.log_schedule().max_frames(steps, time_step));
+        }
+    }
+    if (checkpoint_path != nullptr) {
+        simulation.enable_checkpoints(checkpoint_path, checkpoint_every);
+    }
 
     // add the boids
     std::string vs_src_path = "/home/moltma/Documents/swarmulator/src/shaders/boid.vert";
@@ -64,6 +149,13 @@ int main(int argc, char** argv) {
     vs_src_path = "/home/moltma/Documents/swarmulator/src/shaders/red.vert";
     simulation.new_object_type<swarmulator::BoidEffector>(tri, vs_src_path, fs_src_path);
 
+    // restarts get their objects from the checkpoint
+    if (restore_path != nullptr) {
+        simulation.restore(restore_path);
+        simulation.run();
+        return 0;
+    }
+
     // initialize the boids
     for (int i = 0; i < init_agent_count; i++) {
         const auto p = Vector4{(swarmulator::randfloat() - 0.5f) * world_size.x, (swarmulator::randfloat() - 0.5f) * world_size.y, (swarmulator::randfloat() - 0.5f) * world_size.z, 0};
@@ -0,0 +1,78 @@
+//
+// Created by moltma on 11/14/25.
+//
+
+#ifndef SWARMULATOR_CPP_COMMANDBUFFER_H
+#define SWARMULATOR_CPP_COMMANDBUFFER_H
+#include <new>
+#include <vector>
+
+#include "ObjectPool.h"
+#include "SimObject.h"
+#include "TypeId.h"
+
+namespace swarmulator {
+    /*
+     * spawn and despawn requests made from inside the parallel update
+     * objects can't add or remove objects while everyone is updating, so they queue commands here instead
+     * every thread has its own buffer (objects get theirs through their neighborhood), so queueing never locks
+     * spawned objects are staged in the buffer's own pools (one per type), so spawning doesn't go through the heap either
+     * the simulation applies every buffer in one go once the update is done
+     */
+    class CommandBuffer {
+        friend class Simulation;
+
+    public:
+        struct spawn_command {
+            size_t source; // id of the object that asked for the spawn, spawns are applied in source order
+            type_id_t type;
+            SimObject* object; // staged in this buffer's pool for the type, copied into its group when applied
+        };
+
+    private:
+        std::vector<spawn_command> spawns_{};
+        std::vector<SimObject*> despawns_{};
+        std::vector<ObjectPool> pools_{}; // by type id, slots are reused once spawns are applied
+
+        // destroy the staged spawns and give their slots back (once they are applied)
+        void release_spawns() {
+            for (const auto& [source, type, object] : spawns_) {
+                object->~SimObject();
+                pools_[type].release(object);
+            }
+            spawns_.clear();
+        }
+
+    public:
+        CommandBuffer() = default;
+        ~CommandBuffer() { release_spawns(); }
+        CommandBuffer(const CommandBuffer&) = delete;
+        CommandBuffer& operator=(const CommandBuffer&) = delete;
+        CommandBuffer(CommandBuffer&&) noexcept = default;
+
+        // add a copy of obj to the simulation once the update is done, asked for by the object with id source
+        // new objects get their ids when the spawn is applied, in order of source (and of asking, for the same source)
+        // so ids don't depend on which thread updated whom
+        template<class T>
+        void spawn(const size_t source, const T& obj) {
+            static_assert(std::is_base_of_v<SimObject, T>, "Only SimObjects can be spawned");
+            const auto type = type_id<T>();
+            if (pools_.size() <= type) {
+                pools_.resize(type + 1);
+            }
+            auto& pool = pools_[type];
+            if (pool.slot_size() == 0) {
+                pool = ObjectPool(sizeof(T), alignof(T), 64 << 10);
+            }
+            spawns_.push_back({source, type, new (pool.allocate()) T(obj)});
+        }
+
+        // remove an object from the simulation once the update is done
+        // objects can just deactivate themselves, this is for removing others (neighbors are const while everyone is updating)
+        void despawn(const SimObject& obj) { despawns_.push_back(const_cast<SimObject*>(&obj)); }
+
+        [[nodiscard]] bool empty() const { return spawns_.empty() && despawns_.empty(); }
+    };
+} // namespace swarmulator
+
+#endif // SWARMULATOR_CPP_COMMANDBUFFER_H
@@ -0,0 +1,70 @@
+//
+// Created by moltma on 10/30/25.
+//
+
+#ifndef SWARMULATOR_CPP_NEIGHBORHOOD_H
+#define SWARMULATOR_CPP_NEIGHBORHOOD_H
+#include <vector>
+
+#include "TypeId.h"
+#include "raylib.h"
+
+namespace swarmulator {
+    class SimObject;
+    class CommandBuffer;
+
+    /*
+     * the objects around some object, as found by the grid
+     * a neighborhood is a reusable buffer: the grid clears and refills it for every query, but never gives back its memory
+     * so if every thread keeps its own neighborhood around, queries stop allocating after the first few updates
+     * iterate it like any other container of SimObject pointers, or use for_each_neighbor to only visit one type of object
+     * it also carries the querying thread's command buffer, for spawning and despawning objects from inside an update
+     */
+    class Neighborhood {
+        friend class StaticGrid;
+        friend class Simulation;
+
+    private:
+        std::vector<SimObject*> objects_{}; // the neighbors found by the last query
+        std::vector<Vector3> positions_{}; // their (front buffer) positions
+        std::vector<type_id_t> types_{}; // their type ids
+        std::vector<int> cells_{}; // scratch space for the cell indices the grid visits during a query
+        CommandBuffer* commands_ = nullptr; // the command buffer of the thread this neighborhood belongs to
+
+        void clear() {
+            objects_.clear();
+            positions_.clear();
+            types_.clear();
+            cells_.clear();
+        }
+
+    public:
+        Neighborhood() = default;
+
+        [[nodiscard]] auto begin() const { return objects_.cbegin(); }
+        [[nodiscard]] auto end() const { return objects_.cend(); }
+
+        [[nodiscard]] size_t size() const { return objects_.size(); }
+        [[nodiscard]] bool empty() const { return objects_.empty(); }
+
+        [[nodiscard]] SimObject* operator[](const size_t i) const { return objects_[i]; }
+
+        // queue spawns and despawns here, they are applied once the update is done
+        [[nodiscard]] CommandBuffer& commands() const { return *commands_; }
+
+        // call f(neighbor, position) for every neighbor of exactly type T (not subclasses of T - those are their own group)
+        // type ids are compared instead of casting, so this is cheap enough for the innermost loops
+        // position is the neighbor's front buffer position, handed over so you don't have to go through the neighbor for it
+        template<class T, class F>
+        void for_each_neighbor(F&& f) const {
+            const auto id = type_id<T>();
+            for (size_t i = 0; i < objects_.size(); i++) {
+                if (types_[i] == id) {
+                    f(*static_cast<const T*>(objects_[i]), positions_[i]);
+                }
+            }
+        }
+    };
+} // namespace swarmulator
+
+#endif // SWARMULATOR_CPP_NEIGHBORHOOD_H
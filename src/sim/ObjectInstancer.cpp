@@ -4,58 +4,254 @@
 
 #include "ObjectInstancer.h"
 
+#include <algorithm>
+#include <cstring>
+#include <omp.h>
+
+#include "util.h"
+
 namespace swarmulator {
     ObjectInstancer::~ObjectInstancer() {
         for (const auto& [id, group] : object_groups_) {
-            UnloadShader(group.shader);
-            rlUnloadVertexArray(group.vao_id);
-            rlUnloadShaderBuffer(group.ssbo_id);
+            if (!headless_) {
+                UnloadShader(group.shader);
+                rlUnloadVertexArray(group.vao_id);
+                rlUnloadShaderBuffer(group.ssbo_id);
+            }
+            // the pools give back their slabs when the groups go, objects only need destroying
             for (const auto object : group.objects) {
-                delete object;
+                object->~SimObject();
             }
          }
     }
 
     void ObjectInstancer::update_gpu() {
+        if (headless_) {
+            return;
+        }
+
         // all this does is update the ssbos!!
         for (auto& [id, group] : object_groups_) {
             const size_t group_size = group.objects.size(); // how much space do we need for the transfer?
 
-            group.ssbo_buffer.resize(group_size); // resize the cpu buffer
-            size_t i = 0;
-            // and copy in the objects
-            for (const auto obj : group.objects) {
-                group.ssbo_buffer[i++] = obj->to_ssbo();
-            }
-
             // check gpu buffer capacity and allocate new if necessary
             // allocation is just like std::vector - double capacity every time
+            // the cpu buffer always matches the gpu buffer's capacity, so it only ever grows along with it
+            bool grown = false;
             if (group_size > group.ssbo_capacity) {
+                while (group.ssbo_capacity < group_size) {
+                    group.ssbo_capacity *= 2;
+                }
+                group.ssbo_buffer.resize(group.ssbo_capacity);
+                grown = true;
+            }
+
+            // pack the objects in parallel - hot state comes straight from the columns, only the info needs the object
+            // every entry is compared against what is already in the buffer (what was uploaded last time)
+            // so groups that didn't change at all (like ones that never move) aren't uploaded again
+            const auto& cols = group.columns;
+            auto& buffer = group.ssbo_buffer;
+            const auto& objects = group.objects;
+            bool changed = group_size != group.ssbo_size;
+#pragma omp parallel for schedule(static) reduction(||:changed) shared(cols, buffer, objects, group_size) default(none)
+            for (size_t i = 0; i < group_size; i++) {
+                const SimObject::SSBOObject packed = {
+                    Vector4(cols.positions[i].x, cols.positions[i].y, cols.positions[i].z, 0),
+                    Vector4(cols.rotations[i].x, cols.rotations[i].y, cols.rotations[i].z, 0),
+                    Vector4(cols.scales[i].x, cols.scales[i].y, cols.scales[i].z, 0),
+                    objects[i]->ssbo_info(),
+                };
+                if (std::memcmp(&buffer[i], &packed, sizeof(packed)) != 0) {
+                    buffer[i] = packed;
+                    changed = true;
+                }
+            }
+            group.ssbo_size = group_size;
+
+            if (grown) {
                 // delete old gpu buffer if present
                 if (group.ssbo_id != 0) {
                     rlUnloadShaderBuffer(group.ssbo_id);
                 }
+                // init new buffers (also updates data)
+                group.ssbo_id = rlLoadShaderBuffer(group.ssbo_capacity * sizeof(SimObject::SSBOObject), buffer.data(), RL_DYNAMIC_COPY);
+            }
+            else if (changed && group_size > 0) {
+                // just update buffer data, only as much as is drawn (instance count is the group size)
+                rlUpdateShaderBuffer(group.ssbo_id, buffer.data(), group_size * sizeof(SimObject::SSBOObject), 0);
+            }
+        }
+    }
 
-                // find next power of 2 that fits for size
-                group.ssbo_capacity = 1;
-                while (group.ssbo_capacity < group_size) {
-                    group.ssbo_capacity *= 2;
+    SimObject* ObjectInstancer::add_copy(object_group &group, const SimObject &obj) {
+        return adopt(group, group.clone(&obj, group.pool.allocate()));
+    }
+
+    size_t ObjectInstancer::add_copies(object_group &group, const std::vector<const SimObject*> &objs) {
+        const size_t first = group.objects.size();
+        const size_t n = objs.size();
+        const size_t first_id = next_id_;
+        next_id_ += n;
+        group.objects.resize(first + n);
+        group.columns.resize(first + n);
+        // the pool isn't thread safe, but handing out slots is only a few pointer bumps
+        for (size_t i = 0; i < n; i++) {
+            group.objects[first + i] = static_cast<SimObject*>(group.pool.allocate());
+        }
+
+#pragma omp parallel for schedule(static) shared(group, objs, first, n, first_id) default(none)
+        for (size_t i = 0; i < n; i++) {
+            const auto obj = group.clone(objs[i], group.objects[first + i]);
+            obj->bind(&group.columns, first + i);
+            obj->set_id(first_id + i);
+            obj->swap_state();
+            group.objects[first + i] = obj;
+        }
+        return first;
+    }
+
+    SimObject* ObjectInstancer::adopt(object_group &group, SimObject* obj) {
+        group.objects.push_back(obj);
+        group.columns.resize(group.objects.size());
+        obj->bind(&group.columns, group.objects.size() - 1);
+        obj->set_id(next_id_++);
+        obj->swap_state();
+        return obj;
+    }
+
+    ObjectInstancer::object_group* ObjectInstancer::find_group(const type_id_t type) {
+        for (auto& [id, group] : object_groups_) {
+            if (group.type == type) {
+                return &group;
+            }
+        }
+        return nullptr;
+    }
+
+    void ObjectInstancer::publish(const Vector3 &world_size) {
+        chunk_offsets_.assign(omp_get_max_threads() + 1, 0);
+        for (auto& [id, group] : object_groups_) {
+            const size_t n = group.objects.size();
+            void** freed = nullptr;
+
+            // stream compaction: every thread takes one contiguous chunk of the group and counts its survivors
+            // a prefix sum over the counts gives every chunk the slot its first survivor goes to
+            // then every thread moves its survivors to their slots and publishes them, and destroys everyone else
+            // the dead are released to the pool the same way: everything in a chunk that isn't a survivor is dead,
+            // so every chunk knows where its dead go in the free list too
+            // chunks are in group order, so survivors keep their order no matter how many threads there are
+#pragma omp parallel shared(group, n, freed, world_size) default(none)
+            {
+                const size_t threads = omp_get_num_threads();
+                const size_t thread = omp_get_thread_num();
+                const size_t begin = n * thread / threads;
+                const size_t end = n * (thread + 1) / threads;
+
+                size_t survivors = 0;
+                for (size_t i = begin; i < end; i++) {
+                    survivors += group.objects[i]->active();
+                }
+                chunk_offsets_[thread + 1] = survivors;
+#pragma omp barrier
+#pragma omp single
+                {
+                    for (size_t t = 0; t < threads; t++) {
+                        chunk_offsets_[t + 1] += chunk_offsets_[t];
+                    }
+                    group.compacted.resize(chunk_offsets_[threads]);
+                    group.columns.resize(chunk_offsets_[threads]);
+                    freed = group.pool.release_n(n - chunk_offsets_[threads]);
                 }
 
-                // init new buffers (also updates data)
-                group.ssbo_buffer.resize(group.ssbo_capacity);
-                group.ssbo_id = rlLoadShaderBuffer(group.ssbo_capacity * sizeof(SimObject::SSBOObject), group.ssbo_buffer.data(), RL_DYNAMIC_COPY);
+                size_t slot = chunk_offsets_[thread];
+                size_t dead = begin - chunk_offsets_[thread];
+                for (size_t i = begin; i < end; i++) {
+                    const auto obj = group.objects[i];
+                    if (!obj->active()) {
+                        obj->~SimObject();
+                        freed[dead++] = obj;
+                        continue;
+                    }
+                    group.compacted[slot] = obj;
+                    obj->bind(&group.columns, slot);
+                    obj->swap_state();
+                    obj->set_position(wrap_position(obj->get_position(), world_size));
+                    ++slot;
+                }
+            }
+            group.objects.swap(group.compacted);
+        }
+    }
+
+    void ObjectInstancer::reorder(const std::function<int(const SimObject*)> &key) {
+        std::vector<std::pair<int, SimObject*>> keyed;
+        for (auto& [id, group] : object_groups_) {
+            keyed.clear();
+            for (const auto obj : group.objects) {
+                keyed.emplace_back(key(obj), obj);
             }
-            else {
-                // just update buffer data
-                rlUpdateShaderBuffer(group.ssbo_id, group.ssbo_buffer.data(), group.ssbo_capacity * sizeof(SimObject::SSBOObject), 0);
+            std::stable_sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+            // copy everything into a fresh pool, which hands out slots one after the other, so memory order is the new order
+            // copies start out bound to the old slots, so bind them to their new slots and republish (between updates, back and front buffers are the same)
+            // then the old objects are destroyed, and the old pool gives back all of its slabs at once
+            auto pool = group.pool.like();
+            group.objects.clear();
+            for (const auto& [k, obj] : keyed) {
+                const auto copy = group.clone(obj, pool.allocate());
+                copy->bind(&group.columns, group.objects.size());
+                copy->swap_state();
+                group.objects.push_back(copy);
+            }
+            for (const auto& [k, obj] : keyed) {
+                obj->~SimObject();
             }
+            group.pool = std::move(pool);
         }
     }
 
-    std::list<SimObject*>::iterator ObjectInstancer::remove_object(const std::map<size_t, object_group>::iterator group_it, const std::list<SimObject*>::iterator object_it) {
-        delete *object_it;
-        return group_it->second.objects.erase(object_it);
+    void ObjectInstancer::save(state_writer &out) const {
+        out.put<uint64_t>(next_id_);
+        out.put<uint64_t>(object_groups_.size());
+        for (const auto& [id, group] : object_groups_) {
+            out.put(group.name);
+            out.put<uint64_t>(group.objects.size());
+            for (const auto obj : group.objects) {
+                obj->save_state(out);
+            }
+        }
+    }
+
+    void ObjectInstancer::restore(state_reader &in) {
+        if (size() != 0) {
+            throw std::runtime_error("Checkpoints can only be restored into an empty instancer.");
+        }
+
+        next_id_ = in.get<uint64_t>();
+        const auto groups = in.get<uint64_t>();
+        for (uint64_t g = 0; g < groups; g++) {
+            const auto name = in.get_string();
+            const auto group_it = std::ranges::find_if(object_groups_, [&](const auto& entry) { return entry.second.name == name; });
+            if (group_it == object_groups_.end()) {
+                throw std::runtime_error("Checkpoint has objects of unregistered type " + name + ".");
+            }
+            auto& group = group_it->second;
+            const auto count = in.get<uint64_t>();
+            group.columns.resize(count);
+            for (uint64_t i = 0; i < count; i++) {
+                const auto obj = group.create(group.pool.allocate());
+                try {
+                    obj->restore_state(in);
+                }
+                catch (...) {
+                    destroy(group, obj);
+                    throw;
+                }
+                obj->bind(&group.columns, group.objects.size());
+                obj->swap_state();
+                group.objects.push_back(obj);
+            }
+        }
     }
 
     void ObjectInstancer::draw(const object_group& group, const Matrix & projection, const Matrix & view) {
@@ -78,6 +274,10 @@ namespace swarmulator {
     }
 
     void ObjectInstancer::draw_all(const Matrix & view) const {
+        if (headless_) {
+            return;
+        }
+
         const Matrix projection = rlGetMatrixProjection();
         for (const auto& [id, group] : object_groups_) {
             draw(group, projection, view);
@@ -9,14 +9,18 @@
 
 #ifndef SWARMULATOR_CPP_OBJECTINSTANCER_H
 #define SWARMULATOR_CPP_OBJECTINSTANCER_H
-#include <list>
+#include <functional>
 #include <memory>
 #include <map>
+#include <vector>
 
 #include "raylib.h"
 #include "rlgl.h"
 
+#include "CommandBuffer.h"
+#include "ObjectPool.h"
 #include "SimObject.h"
+#include "TypeId.h"
 
 #define check_t_subtype_simobject static_assert(std::is_base_of_v<SimObject, T>, "Objects registered to or used with the instancer must be an instance of or derive from SimObject")
 
@@ -24,7 +28,15 @@ namespace swarmulator {
     class ObjectInstancer {
     public:
         struct object_group {
-            std::list<SimObject*> objects{}; // all the objects part of this group (these must be pointers because of all the super/subclass stuff)
+            std::vector<SimObject*> objects{}; // all the objects part of this group (these must be pointers because of all the super/subclass stuff)
+            ObjectPool pool{}; // memory the group's objects live in
+            std::vector<SimObject*> compacted{}; // scratch space the survivors are compacted into when publishing (swapped with objects)
+            object_columns columns{}; // front buffers of all the objects in this group, slots in the same order as the objects
+            type_id_t type = 0; // small integer id of this group's type
+            std::string name{}; // the type's name (T::type_name), which is what checkpoints know the group by
+            SimObject* (*clone)(const SimObject*, void*) = nullptr; // copy an object of this group's type into a slot of the pool
+            SimObject* (*create)(void*) = nullptr; // construct a default object of this group's type in a slot of the pool (to restore one into)
+            void (*update_batch)(std::vector<SimObject*>&, float, std::vector<CommandBuffer>&) = nullptr; // optional group-wide update stage, see T::update_batch
             Shader shader{}; // shader we use to draw these objects
             int shader_proj_mat_loc = 0;
             int shader_view_mat_loc = 0;
@@ -33,6 +45,7 @@ namespace swarmulator {
             std::vector<SimObject::SSBOObject> ssbo_buffer; // instance information buffer array
             unsigned int ssbo_id = 0; // gpu id for the ssbo
             size_t ssbo_capacity = 0; // gpu-side ssbo capacity
+            size_t ssbo_size = 0; // how many objects were packed into the ssbo on the last update
         };
 
     private:
@@ -42,15 +55,31 @@ namespace swarmulator {
         // simobject ids are unique for the lifetime of an objectinstancer
         size_t next_id_ = 0;
 
+        // first survivor slot of every thread's chunk when compacting a group (see publish), reused between updates
+        std::vector<size_t> chunk_offsets_{};
+
+        // headless instancers never touch the gpu: no meshes, shaders or ssbos are loaded, and nothing is drawn
+        bool headless_ = false;
+
         template<class T>
         static size_t get_gid() { return typeid(T).hash_code(); }
 
+        // take over management of an object that lives in its group's pool, as the last object of the group
+        // gives it the next object id, the next slot in the group's columns, and publishes its state there right away
+        SimObject* adopt(object_group &group, SimObject* obj);
+        // destroy an object of a group and give its memory back to the group's pool
+        static void destroy(object_group &group, SimObject* obj) {
+            obj->~SimObject();
+            group.pool.release(obj);
+        }
+
         // draw a given group
         // wrap with calls to begin and end 3d mode
         static void draw(const object_group& group, const Matrix &projection, const Matrix &view);
 
     public:
         ObjectInstancer() = default;
+        explicit ObjectInstancer(const bool headless) : headless_(headless) {}
         ~ObjectInstancer();
 
         // allocate a new object group from a type
@@ -64,6 +93,22 @@ namespace swarmulator {
             }
 
             object_group group;
+            group.type = type_id<T>();
+            group.name = T().type_name();
+            group.pool = ObjectPool(sizeof(T), alignof(T));
+            group.create = [](void* at) -> SimObject* { return new (at) T(); };
+            group.clone = [](const SimObject* obj, void* at) -> SimObject* { return new (at) T(*static_cast<const T*>(obj)); };
+            // types that do part of their update over the whole group at once bring a static update_batch(objects, dt, commands)
+            // (commands has a command buffer per thread, see CommandBuffer)
+            if constexpr (requires(std::vector<SimObject*>& objects, float dt, std::vector<CommandBuffer>& commands) { T::update_batch(objects, dt, commands); }) {
+                group.update_batch = &T::update_batch;
+            }
+
+            // without a gl context there is nothing more to set up
+            if (headless_) {
+                object_groups_[gid] = std::move(group);
+                return;
+            }
 
             // set up mesh
             group.vao_id = rlLoadVertexArray();
@@ -96,14 +141,15 @@ namespace swarmulator {
             // set up ssbo
             group.ssbo_id = rlLoadShaderBuffer(group.ssbo_capacity * sizeof(SimObject::SSBOObject), group.ssbo_buffer.data(), RL_DYNAMIC_COPY); // unloaded in destructor
 
-            object_groups_[gid] = group;
+            object_groups_[gid] = std::move(group);
         }
 
         // add an object to its group
         // object id is set according to the next available object id
         // the object passed is copied, and management is taken over by the instancer
+        // returns the managed copy
         template<class T>
-        void add_object(const T& obj) {
+        T* add_object(const T& obj) {
             check_t_subtype_simobject; // make sure t is a subtype of a simulation object (at compiletime)
             const auto gid = get_gid<T>();
 
@@ -111,19 +157,40 @@ namespace swarmulator {
                 throw std::runtime_error("Object group does not exist.");
             }
 
-            object_group &group = object_groups_[gid];
-            auto managed = new T(obj); // deleted in destructor
-            group.objects.push_back(managed);
-            group.objects.back()->set_id(next_id_++); // set id (doing it like this avoids having to cast)
+            return static_cast<T*>(add_copy(object_groups_[gid], obj));
         }
 
+        // add a copy of an object (of exactly the group's type) to a group, the same way as add_object
+        // for adding objects whose type is only known at runtime, like spawned ones
+        SimObject* add_copy(object_group &group, const SimObject &obj);
+        // add copies of many objects (all of exactly the group's type) to the end of a group at once, in order
+        // slots and ids are handed out up front, then the copies are made, bound and published in parallel
+        // returns the index of the first copy in the group's objects
+        size_t add_copies(object_group &group, const std::vector<const SimObject*> &objs);
+
+        // the group for a type id, nullptr if there is none
+        object_group* find_group(type_id_t type);
+
+        // publish the state of every object to its group's columns, at the end of an update
+        // inactive objects are removed (and destroyed) on the way, survivors keep their order and are (re)bound to their new slots
+        // positions are wrapped into a world of the given size on the way too (donut world)
+        // all of that happens in one parallel pass over every group
+        void publish(const Vector3 &world_size);
+
         // update shaders with group information
         void update_gpu();
 
-        // remove an object from the simulation, given iterators to its group and itself within the group
-        // using this manages the memory allocated by the instancer
-        // yes, it could be static, but conceptually i like it not that way
-        std::list<SimObject *>::iterator remove_object(std::map<size_t, object_group>::iterator group_it, std::list<SimObject *>::iterator object_it);
+        // physically reorder every group's objects by some key (like their grid cell), keeping equal keys in their current order
+        // objects are copied into a fresh pool in the new order, so objects with close keys also end up close in memory
+        // this invalidates all pointers to objects, so only call it between updates and before sorting them into a grid
+        void reorder(const std::function<int(const SimObject*)> &key);
+
+        // write every group's objects (and the next object id) to a checkpoint
+        // groups are written by name, objects in group order, each one through its save_state
+        void save(state_writer &out) const;
+        // bring back the objects from a checkpoint written by save, keeping their ids
+        // every group in the checkpoint has to be registered already, and all groups have to be empty
+        void restore(state_reader &in);
 
         // draw all groups
         // wrap with calls to begin and end 3d mode
@@ -141,6 +208,8 @@ namespace swarmulator {
 
         // number of objects currently in the instancer: sum of the size of all object lists in all groups
         [[nodiscard]] size_t size() const;
+
+        [[nodiscard]] bool headless() const { return headless_; }
     };
 }
 
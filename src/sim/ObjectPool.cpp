@@ -0,0 +1,52 @@
+//
+// Created by moltma on 11/15/25.
+//
+
+#include "ObjectPool.h"
+
+#include <algorithm>
+#include <new>
+#include <utility>
+
+namespace swarmulator {
+    ObjectPool::ObjectPool(const size_t size, const size_t align, const size_t slab_bytes) :
+        size_((size + align - 1) / align * align), align_(align), slab_slots_(std::max<size_t>(1, slab_bytes / size_)) {}
+
+    ObjectPool::ObjectPool(ObjectPool&& other) noexcept :
+        size_(other.size_), align_(other.align_), slab_slots_(other.slab_slots_),
+        slabs_(std::move(other.slabs_)), used_(other.used_), free_(std::move(other.free_)) {
+        other.slabs_.clear();
+        other.free_.clear();
+        other.used_ = 0;
+    }
+
+    ObjectPool& ObjectPool::operator=(ObjectPool&& other) noexcept {
+        if (this != &other) {
+            free_slabs();
+            size_ = other.size_;
+            align_ = other.align_;
+            slab_slots_ = other.slab_slots_;
+            slabs_ = std::move(other.slabs_);
+            used_ = other.used_;
+            free_ = std::move(other.free_);
+            other.slabs_.clear();
+            other.free_.clear();
+            other.used_ = 0;
+        }
+        return *this;
+    }
+
+    void ObjectPool::add_slab() {
+        slabs_.push_back(static_cast<std::byte*>(::operator new(size_ * slab_slots_, std::align_val_t(align_))));
+        used_ = 0;
+    }
+
+    void ObjectPool::free_slabs() {
+        for (const auto slab : slabs_) {
+            ::operator delete(slab, std::align_val_t(align_));
+        }
+        slabs_.clear();
+        free_.clear();
+        used_ = 0;
+    }
+} // namespace swarmulator
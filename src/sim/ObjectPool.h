@@ -0,0 +1,78 @@
+//
+// Created by moltma on 11/15/25.
+//
+
+#ifndef SWARMULATOR_CPP_OBJECTPOOL_H
+#define SWARMULATOR_CPP_OBJECTPOOL_H
+#include <cstddef>
+#include <vector>
+
+namespace swarmulator {
+    /*
+     * slab storage for the objects of one group (which all have the same type, so the same size)
+     * objects are placed into fixed-size slots carved out of big slabs, instead of being allocated one by one on the heap
+     * freed slots go on a free list and are handed out again first, so churn (births and deaths) reuses the same memory
+     * and a group stays packed into a few slabs instead of being spread over the whole heap
+     * the pool only hands out memory: constructing objects in it and destroying them before releasing is up to the owner
+     * slabs are only given back when the pool goes away (all at once, without visiting objects)
+     */
+    class ObjectPool {
+    private:
+        size_t size_ = 0; // bytes per slot (object size rounded up to its alignment)
+        size_t align_ = alignof(std::max_align_t);
+        size_t slab_slots_ = 0; // slots per slab
+        std::vector<std::byte*> slabs_{};
+        size_t used_ = 0; // slots of the last slab that were handed out at least once
+        std::vector<void*> free_{}; // released slots, handed out again last in first out
+
+        void add_slab();
+        void free_slabs();
+
+    public:
+        ObjectPool() = default;
+        // a pool for objects of the given size and alignment, in slabs of about slab_bytes
+        ObjectPool(size_t size, size_t align, size_t slab_bytes = 1 << 20);
+        ~ObjectPool() { free_slabs(); }
+
+        ObjectPool(const ObjectPool&) = delete;
+        ObjectPool& operator=(const ObjectPool&) = delete;
+        ObjectPool(ObjectPool&& other) noexcept;
+        ObjectPool& operator=(ObjectPool&& other) noexcept;
+
+        // an empty pool for objects of the same size and alignment
+        [[nodiscard]] ObjectPool like() const { return {size_, align_, size_ * slab_slots_}; }
+
+        // memory for one object, O(1): a released slot if there is one, otherwise the next slot of the last slab (or a new slab)
+        void* allocate() {
+            if (!free_.empty()) {
+                const auto slot = free_.back();
+                free_.pop_back();
+                return slot;
+            }
+            if (slabs_.empty() || used_ == slab_slots_) {
+                add_slab();
+            }
+            return slabs_.back() + size_ * used_++;
+        }
+
+        // give back the slot of an object that was already destroyed
+        void release(void* slot) { free_.push_back(slot); }
+
+        // make room for n released slots at once and return where to write them
+        // lets threads release disjoint ranges of slots in parallel, without locking the free list
+        void** release_n(const size_t n) {
+            const auto at = free_.size();
+            free_.resize(at + n);
+            return free_.data() + at;
+        }
+
+        // bytes per slot, 0 for a default constructed pool (which can't hand out anything)
+        [[nodiscard]] size_t slot_size() const { return size_; }
+        // slots handed out right now
+        [[nodiscard]] size_t size() const { return capacity() - free_.size(); }
+        // slots in all slabs that were handed out at least once
+        [[nodiscard]] size_t capacity() const { return slabs_.empty() ? 0 : (slabs_.size() - 1) * slab_slots_ + used_; }
+    };
+} // namespace swarmulator
+
+#endif // SWARMULATOR_CPP_OBJECTPOOL_H
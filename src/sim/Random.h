@@ -0,0 +1,135 @@
+//
+// Created by moltma on 11/13/25.
+//
+
+#ifndef SWARMULATOR_CPP_RANDOM_H
+#define SWARMULATOR_CPP_RANDOM_H
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace swarmulator {
+    /*
+     * counter-based random numbers (philox4x32-10, salmon et al. 2011, "parallel random numbers: as easy as 1, 2, 3")
+     * every block of 4 random words is a pure function of a key and a counter, there is no generator state to share or lock
+     * so any thread can draw any object's numbers, in any order, and get the same ones every time
+     * streams are keyed by the run's seed, and counted by what they are for (object id, step, purpose) and how far along they are
+     */
+    namespace philox {
+        using counter = std::array<uint32_t, 4>;
+        using key = std::array<uint32_t, 2>;
+
+        inline constexpr counter round(const counter &c, const key &k) {
+            const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c[0];
+            const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c[2];
+            return {
+                static_cast<uint32_t>(p1 >> 32) ^ c[1] ^ k[0], static_cast<uint32_t>(p1),
+                static_cast<uint32_t>(p0 >> 32) ^ c[3] ^ k[1], static_cast<uint32_t>(p0),
+            };
+        }
+
+        // the 4 random words for one counter value
+        inline constexpr counter block(counter c, key k) {
+            for (int r = 0; r < 10; r++) {
+                if (r > 0) {
+                    k[0] += 0x9E3779B9u;
+                    k[1] += 0xBB67AE85u;
+                }
+                c = round(c, k);
+            }
+            return c;
+        }
+
+        // uniform float in [0, 1) from the top 24 bits of a random word
+        inline constexpr float to_unit(const uint32_t x) {
+            return static_cast<float>(x >> 8) * 0x1p-24f;
+        }
+    } // namespace philox
+
+    // the seed every stream is keyed by, process-wide like type ids
+    // set it once before setting up a run, it is saved with checkpoints
+    inline std::atomic<uint64_t>& random_seed_ref() {
+        static std::atomic<uint64_t> seed{0};
+        return seed;
+    }
+    // how many numbers randfloat has handed out since the seed was set
+    inline std::atomic<uint64_t>& random_draws_ref() {
+        static std::atomic<uint64_t> draws{0};
+        return draws;
+    }
+    inline uint64_t random_seed() { return random_seed_ref().load(std::memory_order_relaxed); }
+    inline void set_random_seed(const uint64_t seed, const uint64_t draws = 0) {
+        random_seed_ref().store(seed, std::memory_order_relaxed);
+        random_draws_ref().store(draws, std::memory_order_relaxed);
+    }
+    inline uint64_t random_draws() { return random_draws_ref().load(std::memory_order_relaxed); }
+
+    // what a stream of random numbers is for, so streams for different things never overlap
+    enum class random_purpose : uint32_t {
+        setup, // scene setup, outside of the update
+        brain, // initial brain weights
+        mutation,
+        draw, // reserved for randfloat's counter, never make a stream with it (its numbers would repeat randfloat's)
+        user = 1 << 16, // first purpose free for simulations and objects to use
+    };
+
+    /*
+     * a stream of random numbers for one (object id, step, purpose)
+     * cheap to make (it's just a key and a counter), so make one wherever you need numbers instead of passing one around
+     * the counter's first word counts blocks, so a stream has 2^34 numbers before it wraps around
+     * ids and steps are counted in 32 bits, their high bits are folded into the key
+     */
+    class random_stream {
+    private:
+        philox::key key_;
+        philox::counter counter_;
+        philox::counter block_{};
+        unsigned int used_ = 4; // words of block_ already handed out
+
+    public:
+        random_stream(const uint64_t seed, const uint64_t id, const uint64_t step, const random_purpose purpose)
+            : key_{static_cast<uint32_t>(seed) ^ static_cast<uint32_t>(id >> 32), static_cast<uint32_t>(seed >> 32) ^ static_cast<uint32_t>(step >> 32)},
+              counter_{0, static_cast<uint32_t>(purpose), static_cast<uint32_t>(id), static_cast<uint32_t>(step)} {}
+        // keyed by the process-wide seed
+        random_stream(const uint64_t id, const uint64_t step, const random_purpose purpose) : random_stream(random_seed(), id, step, purpose) {}
+
+        uint32_t next_u32() {
+            if (used_ == 4) {
+                block_ = philox::block(counter_, key_);
+                ++counter_[0];
+                used_ = 0;
+            }
+            return block_[used_++];
+        }
+
+        // uniform float in [0, 1)
+        float uniform() { return philox::to_unit(next_u32()); }
+        // uniform float in [min, max)
+        float uniform(const float min, const float max) { return min + (max - min) * uniform(); }
+
+        // n uniform floats in [0, 1), whole blocks at a time
+        // blocks don't depend on each other, so this loop vectorizes (and is the fast way to get a lot of numbers)
+        // starts at the next whole block, so mixing this with single draws skips whatever is left of the current one
+        void fill_uniform(float* out, const size_t n) {
+            const size_t blocks = (n + 3) / 4;
+            const uint32_t first = counter_[0];
+            for (size_t b = 0; b < blocks; b++) {
+                const auto words = philox::block({first + static_cast<uint32_t>(b), counter_[1], counter_[2], counter_[3]}, key_);
+                for (size_t w = 0; w < 4 && b * 4 + w < n; w++) {
+                    out[b * 4 + w] = philox::to_unit(words[w]);
+                }
+            }
+            counter_[0] = first + static_cast<uint32_t>(blocks);
+            used_ = 4;
+        }
+    };
+
+    // a fresh stream for setting things up outside of the update (like initial brains)
+    // takes the next setup draw as its id, so it's the same stream for the same seed as long as setup happens on one thread
+    inline random_stream setup_stream(const random_purpose purpose) {
+        return {random_seed(), random_draws_ref().fetch_add(1, std::memory_order_relaxed), 0, purpose};
+    }
+} // namespace swarmulator
+
+#endif // SWARMULATOR_CPP_RANDOM_H
@@ -4,15 +4,50 @@
 
 #ifndef SWARMULATOR_CPP_SIMOBJECT_H
 #define SWARMULATOR_CPP_SIMOBJECT_H
+#include <cstdint>
 #include <list>
 #include <memory>
 #include <vector>
 
+#include "Neighborhood.h"
+#include "checkpoint/State.h"
 #include "raylib.h"
 
 namespace swarmulator {
+    // hot state of every object in a group, as structure of arrays
+    // owned by the object instancer, one per group, and indexed by slot (objects are bound to slots in group order)
+    // this is the front buffer of every object in the group: each object publishes its state into its own slot once per update
+    // so anything that only needs positions, rotations etc. can stream over flat arrays instead of chasing object pointers
+    struct object_columns {
+        std::vector<Vector3> positions{};
+        std::vector<Vector3> rotations{};
+        std::vector<Vector3> velocities{};
+        std::vector<Vector3> scales{};
+        std::vector<size_t> ids{};
+        std::vector<uint8_t> active{};
+
+        void resize(const size_t n) {
+            positions.resize(n);
+            rotations.resize(n);
+            velocities.resize(n);
+            scales.resize(n);
+            ids.resize(n);
+            active.resize(n);
+        }
+
+        [[nodiscard]] size_t size() const { return positions.size(); }
+    };
+
+    // the range of values one column of an object's dynamic log row can take
+    struct log_range {
+        uint32_t column;
+        float min;
+        float max;
+    };
+
     class SimObject {
     protected:
+        // back buffer: the state an object reads and writes for itself during its own update (frame N+1)
         Vector3 position_ = Vector3(0, 0, 0);
         Vector3 rotation_ = Vector3(0, 0, 0); // TODO move to quaternions maybe in future
         Vector3 velocity_ = Vector3(0, 0, 0);
@@ -24,6 +59,18 @@ namespace swarmulator {
 
         size_t id_ = 0;
 
+    private:
+        // where this object's front buffer lives in its group's columns
+        // copying an object never copies this, so copies start out unbound and can't scribble over someone else's slot
+        struct column_slot {
+            object_columns* columns = nullptr;
+            size_t slot = 0;
+
+            column_slot() = default;
+            column_slot(const column_slot&) {}
+            column_slot& operator=(const column_slot&) { return *this; }
+        } front_;
+
     public:
         // struct for passing simobject info to gpu buffers
         struct SSBOObject {
@@ -40,17 +87,32 @@ namespace swarmulator {
 
         virtual ~SimObject() = default;
 
-        void set_position(const Vector3 position) { position_ = position; }
-        [[nodiscard]] Vector3 get_position() const { return position_; }
-
-        void set_rotation(const Vector3 rotation) { rotation_ = rotation; }
-        [[nodiscard]] Vector3 get_rotation() const { return rotation_; }
-
-        void set_velocity(const Vector3 velocity) { velocity_ = velocity; }
-        [[nodiscard]] Vector3 get_velocity() const { return velocity_; }
-
-        void set_scale(const Vector3 scale) { scale_ = scale; }
-        [[nodiscard]] Vector3 get_scale() const { return scale_; }
+        // getters read the front buffer (this object's slot in its group's columns), so they are safe to call on neighbors from inside an update
+        // objects that aren't managed by an instancer have no front buffer, and just return their own state
+        // setters write both buffers, so only call them outside of the update phase
+        void set_position(const Vector3 position) {
+            position_ = position;
+            if (front_.columns) front_.columns->positions[front_.slot] = position;
+        }
+        [[nodiscard]] Vector3 get_position() const { return front_.columns ? front_.columns->positions[front_.slot] : position_; }
+
+        void set_rotation(const Vector3 rotation) {
+            rotation_ = rotation;
+            if (front_.columns) front_.columns->rotations[front_.slot] = rotation;
+        }
+        [[nodiscard]] Vector3 get_rotation() const { return front_.columns ? front_.columns->rotations[front_.slot] : rotation_; }
+
+        void set_velocity(const Vector3 velocity) {
+            velocity_ = velocity;
+            if (front_.columns) front_.columns->velocities[front_.slot] = velocity;
+        }
+        [[nodiscard]] Vector3 get_velocity() const { return front_.columns ? front_.columns->velocities[front_.slot] : velocity_; }
+
+        void set_scale(const Vector3 scale) {
+            scale_ = scale;
+            if (front_.columns) front_.columns->scales[front_.slot] = scale;
+        }
+        [[nodiscard]] Vector3 get_scale() const { return front_.columns ? front_.columns->scales[front_.slot] : scale_; }
 
         void set_interaction_radius(const float radius) { interaction_radius_ = radius; }
         [[nodiscard]] float get_interaction_radius() const { return interaction_radius_; }
@@ -60,20 +122,97 @@ namespace swarmulator {
         void deactivate() { active_ = false; }
 
         [[nodiscard]] size_t get_id() const { return id_; }
-        void set_id(const size_t id) { id_ = id; }
+        void set_id(const size_t id) {
+            id_ = id;
+            if (front_.columns) front_.columns->ids[front_.slot] = id;
+        }
+
+        // bind this object's front buffer to a slot in its group's columns
+        // the instancer does this whenever slots change - you shouldn't need to
+        void bind(object_columns* columns, const size_t slot) {
+            front_.columns = columns;
+            front_.slot = slot;
+        }
+        [[nodiscard]] size_t slot() const { return front_.slot; }
 
         // called at every update
-        virtual void update(const std::list<SimObject *> &neighborhood, float dt) {}
-
-        [[nodiscard]] virtual SSBOObject to_ssbo() const;
+        // write only to your own (back buffer) state here, and read neighbors only through their getters
+        virtual void update(const Neighborhood &neighborhood, float dt) {}
+
+        // publish the back buffer as the new front buffer (this object's slot in its group's columns)
+        // called for every object once all objects have been updated
+        // override this (and call the base) if your object exposes more state to its neighbors
+        virtual void swap_state() {
+            if (!front_.columns) {
+                return;
+            }
+            front_.columns->positions[front_.slot] = position_;
+            front_.columns->rotations[front_.slot] = rotation_;
+            front_.columns->velocities[front_.slot] = velocity_;
+            front_.columns->scales[front_.slot] = scale_;
+            front_.columns->ids[front_.slot] = id_;
+            front_.columns->active[front_.slot] = active_;
+        }
+
+        // extra per-instance information for this object's shader (the info member of its SSBOObject)
+        // position, rotation and scale are packed straight from the group columns
+        [[nodiscard]] virtual Vector4 ssbo_info() const { return Vector4(0, 0, 0, 0); }
 
         [[nodiscard]] virtual std::string type_name() const { return "SimObject"; }
-        // dynamic object information
+        // dynamic object information, appended to the end of row
         // should include the object id cast to float somewhere, since the logger doesn't track that
-        [[nodiscard]] virtual std::vector<float> log() const { return { static_cast<float>(id_), position_.x, position_.y, position_.z, rotation_.x, rotation_.y, rotation_.z}; };
+        // called from inside the parallel update with a reused staging buffer, so only ever append (and always the same number of values)
+        virtual void log_row(std::vector<float> &row) const { row.insert(row.end(), { static_cast<float>(id_), position_.x, position_.y, position_.z, rotation_.x, rotation_.y, rotation_.z }); }
+        // the same, as a fresh vector
+        [[nodiscard]] std::vector<float> log() const {
+            std::vector<float> row;
+            log_row(row);
+            return row;
+        }
+        // columns of the dynamic log row with a known range of values, which the logger may store as 16 bit fixed point instead of floats
+        // (only if the log options ask for it) - values outside the range are clamped
+        // positions are inside the world bounds (rows are logged after publish, which wraps them), headings are unit vectors
+        [[nodiscard]] virtual std::vector<log_range> log_ranges(const Vector3 &world_size) const {
+            return {
+                {1, -world_size.x / 2, world_size.x / 2}, {2, -world_size.y / 2, world_size.y / 2}, {3, -world_size.z / 2, world_size.z / 2},
+                {4, -1, 1}, {5, -1, 1}, {6, -1, 1},
+            };
+        }
+        // per-object parameters that are set at birth and never change afterwards (e.g. evolved weights), appended to the end of row
+        // logged once per object when it is added (meta/genome), so they don't have to be repeated in every dynamic row
+        // always the same number of values for a type, none (the default) if the type doesn't have a genome
+        virtual void genome_row([[maybe_unused]] std::vector<float> &row) const {}
+        // the same, as a fresh vector
+        [[nodiscard]] std::vector<float> genome_log() const {
+            std::vector<float> row;
+            genome_row(row);
+            return row;
+        }
         // static object information
         // object parameters which do not change over time for all objects of this type
         [[nodiscard]] virtual std::vector<float> static_log() const { return { interaction_radius_ }; }
+
+        // everything needed to bring this object back from a checkpoint, as raw bytes
+        // override (and call the base first) if your object has more state, and read back exactly what you wrote in restore_state
+        // only called between updates, when the front and back buffers are the same, so only the back buffer is saved
+        virtual void save_state(state_writer &out) const {
+            out.put(position_);
+            out.put(rotation_);
+            out.put(velocity_);
+            out.put(scale_);
+            out.put(active_);
+            out.put(interaction_radius_);
+            out.put(id_);
+        }
+        virtual void restore_state(state_reader &in) {
+            in.get(position_);
+            in.get(rotation_);
+            in.get(velocity_);
+            in.get(scale_);
+            in.get(active_);
+            in.get(interaction_radius_);
+            in.get(id_);
+        }
     };
 }
 
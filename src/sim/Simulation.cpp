@@ -4,9 +4,18 @@
 
 #include "Simulation.h"
 
+#include <algorithm>
+#include <chrono>
 #include <omp.h>
 
+#include "Random.h"
+#include "checkpoint/MappedFile.h"
+
 namespace swarmulator {
+    // checkpoint file header, bump the version whenever the layout changes
+    static constexpr uint64_t checkpoint_magic = 0x54504b434d525753; // "SWRMCKPT"
+    static constexpr uint32_t checkpoint_version = 4;
+
     Simulation::Simulation() : grid_(world_size_, grid_divisions_), logger_() {
         InitWindow(800, 600, "Swarmulator");
         camera_ = {
@@ -34,67 +43,340 @@ namespace swarmulator {
         omp_set_num_threads(sim_threads_); // can use maximum threads if not logging
     }
 
+    Simulation::Simulation(const Vector3 world_size, const size_t grid_divisions) :
+        world_size_(world_size), grid_divisions_(grid_divisions), grid_(world_size, grid_divisions), object_instancer_(true), logger_(), headless_(true) {
+        // no window, so no camera either
+        camera_ = {};
+        sim_threads_ = omp_get_max_threads();
+        omp_set_num_threads(sim_threads_);
+    }
+
+    void Simulation::enable_logging(const std::string &path, const log_options &options, const size_t max_frames) {
+        if (object_instancer_.begin() != object_instancer_.end()) {
+            throw std::runtime_error("Logging has to be enabled before adding object types.");
+        }
+        logger_.initialize(path, options, max_frames, log_static().size(), log_dynamic().size());
+        if (const auto sl = log_static(); !sl.empty()) {
+            logger_.queue_log_sim_data(sl, false);
+        }
+    }
+
+    void Simulation::resume_logging(const std::string &path, const log_options &options) {
+        if (object_instancer_.begin() != object_instancer_.end()) {
+            throw std::runtime_error("Logging has to be resumed before adding object types.");
+        }
+        logger_.resume(path, options);
+    }
+
+    void Simulation::enable_checkpoints(const std::string &path, const size_t interval) {
+        checkpoint_writer_ = std::make_unique<CheckpointWriter>(path);
+        checkpoint_interval_ = interval;
+    }
+
+    void Simulation::checkpoint() {
+        if (!checkpoint_writer_) {
+            throw std::runtime_error("Checkpoints were not enabled.");
+        }
+
+        checkpoint_blob_.clear();
+        state_writer out(checkpoint_blob_);
+        out.put(checkpoint_magic);
+        out.put(checkpoint_version);
+        out.put(world_size_);
+        out.put(grid_divisions_);
+        out.put(total_time_);
+        out.put<uint64_t>(total_steps_);
+        // random streams are keyed by seed, object and step, so the seed and how far the setup stream got are all the rng state there is
+        out.put(random_seed());
+        out.put(random_draws());
+
+        // where the log is (as queued, the worker might not have gotten there yet), and what the schedule has done per type
+        out.put<uint8_t>(logger_.initialized());
+        if (logger_.initialized()) {
+            const auto position = logger_.position();
+            out.put(position.frame);
+            out.put<uint64_t>(position.groups.size());
+            for (const auto& [name, rows, objects] : position.groups) {
+                out.put(name);
+                out.put(rows);
+                out.put(objects);
+            }
+        }
+        out.put<uint64_t>(std::distance(object_instancer_.begin(), object_instancer_.end()));
+        for (auto grp = object_instancer_.begin(); grp != object_instancer_.end(); ++grp) {
+            out.put(grp->second.name);
+            const auto [logged, last_time_slot] = log_schedule_.progress(grp->second.type);
+            out.put(logged);
+            out.put(last_time_slot);
+        }
+
+        save_state(out);
+        object_instancer_.save(out);
+
+        // the checkpoint is only worth something if the log gets to where it says, so push the log out to disk as well
+        // and don't let the checkpoint replace the last one before it has (the worker can be many frames behind)
+        std::function<void()> log_flushed;
+        if (logger_.initialized()) {
+            log_flushed = [this, ticket = logger_.queue_flush()] { logger_.wait_flushed(ticket); };
+        }
+        checkpoint_writer_->write(checkpoint_blob_, std::move(log_flushed));
+    }
+
+    void Simulation::restore(const std::string &path) {
+        const MappedFile file(path);
+        auto in = file.reader();
+        if (in.get<uint64_t>() != checkpoint_magic || in.get<uint32_t>() != checkpoint_version) {
+            throw std::runtime_error(path + " is not a checkpoint this version can read.");
+        }
+        const auto world_size = in.get<Vector3>();
+        const auto grid_divisions = in.get<int>();
+        if (world_size.x != world_size_.x || world_size.y != world_size_.y || world_size.z != world_size_.z || grid_divisions != grid_divisions_) {
+            throw std::runtime_error("Checkpoint was taken in a different world.");
+        }
+        total_time_ = in.get<double>();
+        total_steps_ = in.get<uint64_t>();
+        const auto seed = in.get<uint64_t>();
+        const auto draws = in.get<uint64_t>();
+
+        // a resumed log is cut back to the checkpoint, a fresh one just starts here
+        if (in.get<uint8_t>()) {
+            log_position position{in.get<uint64_t>(), {}};
+            const auto groups = in.get<uint64_t>();
+            for (uint64_t g = 0; g < groups; g++) {
+                auto name = in.get_string();
+                const auto rows = in.get<uint64_t>();
+                const auto objects = in.get<uint64_t>();
+                position.groups.push_back({std::move(name), rows, objects});
+            }
+            if (logger_.appending()) {
+                logger_.rewind(position);
+            }
+        }
+        const auto groups = in.get<uint64_t>();
+        for (uint64_t g = 0; g < groups; g++) {
+            const auto name = in.get_string();
+            log_progress progress{};
+            in.get(progress.logged);
+            in.get(progress.last_time_slot);
+            for (auto grp = object_instancer_.begin(); grp != object_instancer_.end(); ++grp) {
+                if (grp->second.name == name) {
+                    log_schedule_.set_progress(grp->second.type, progress);
+                }
+            }
+        }
+
+        restore_state(in);
+        object_instancer_.restore(in);
+
+        set_random_seed(seed, draws);
+    }
+
+    void Simulation::apply_spawns() {
+        spawns_.clear();
+        for (const auto& commands : commands_) {
+            spawns_.insert(spawns_.end(), commands.spawns_.begin(), commands.spawns_.end());
+        }
+        if (spawns_.empty()) {
+            return;
+        }
+
+        // which thread updated whom depends on scheduling, so order spawns by who asked for them before handing out ids
+        // stable, so spawns of the same source keep the order they were asked for in
+        // then every type gets its spawns as one batch, ids go to the batches in type order
+        std::ranges::stable_sort(spawns_, {}, &CommandBuffer::spawn_command::source);
+        for (const auto& [source, type, object] : spawns_) {
+            if (spawn_batches_.size() <= type) {
+                spawn_batches_.resize(type + 1);
+            }
+            spawn_batches_[type].objects.push_back(object);
+        }
+
+        const bool logging = logger_.initialized();
+        for (type_id_t type = 0; type < spawn_batches_.size(); type++) {
+            // (no structured binding, openmp can't share those)
+            auto& batch = spawn_batches_[type].objects;
+            auto& ids = spawn_batches_[type].ids;
+            auto& genomes = spawn_batches_[type].genomes;
+            if (batch.empty()) {
+                continue;
+            }
+            const auto group = object_instancer_.find_group(type);
+            if (!group) {
+                throw std::runtime_error("Spawned an object of a type that was never registered.");
+            }
+            // positions are wrapped when the update is published, like everyone else's
+            const size_t first = object_instancer_.add_copies(*group, batch);
+
+            // log the whole batch in one task, genomes are gathered in parallel
+            if (logging) {
+                const auto& objects = group->objects;
+                const size_t n = batch.size();
+                const size_t width = objects[first]->genome_log().size();
+                ids.resize(n);
+                genomes.resize(n * width);
+#pragma omp parallel for schedule(static) shared(objects, ids, genomes, first, n, width) default(none)
+                for (size_t i = 0; i < n; i++) {
+                    const auto obj = objects[first + i];
+                    ids[i] = obj->get_id();
+                    if (width > 0) {
+                        const auto genome = obj->genome_log();
+                        std::copy(genome.begin(), genome.end(), genomes.begin() + static_cast<std::ptrdiff_t>(i * width));
+                    }
+                }
+                logger_.queue_new_objects(type, ids, genomes);
+            }
+            batch.clear();
+        }
+        spawns_.clear();
+
+        // the staged objects were copied into their groups, so their slots can be reused
+#pragma omp parallel for schedule(static, 1) default(none)
+        for (size_t t = 0; t < commands_.size(); t++) {
+            commands_[t].release_spawns();
+        }
+    }
+
     void Simulation::update(const float dt, const bool log) {
         total_time_ += dt;
         ++total_steps_;
 
-        // remove inactive objects, wrap bounds (donut world)
-        for (auto group_it = object_instancer_.begin(); group_it != object_instancer_.end(); ++group_it) {
-            auto obj_it = group_it->second.objects.begin();
-            while (obj_it != group_it->second.objects.end()) {
-                if (const auto obj_ptr = *obj_it; !obj_ptr->active()) {
-                    obj_it = object_instancer_.remove_object(group_it, obj_it);
+        // make sure every thread has a neighborhood buffer (thread count can change between updates)
+        if (const size_t threads = omp_get_max_threads(); neighborhoods_.size() < threads) {
+            neighborhoods_.resize(threads);
+            commands_.resize(threads);
+            // resizing moves the command buffers, so point every neighborhood at its thread's buffer again
+            for (size_t t = 0; t < threads; t++) {
+                neighborhoods_[t].commands_ = &commands_[t];
+            }
+        }
+        // ask the schedule which types are due, and only write a log frame if any of them are (and the logger's budget lets it through)
+        bool log_frame = false;
+        if (log) {
+            for (auto grp = object_instancer_.begin(); grp != object_instancer_.end(); ++grp) {
+                const auto type = grp->second.type;
+                if (log_due_.size() <= type) {
+                    log_due_.resize(type + 1, 0);
                 }
-                else {
-                    obj_ptr->set_position(wrap_position(obj_ptr->get_position(), world_size_));
-                    ++obj_it;
+                log_due_[type] = log_schedule_.due(type, total_steps_, total_time_);
+                log_frame |= log_due_[type];
+            }
+            log_frame = log_frame && logger_.admit_frame();
+            // only frames that actually get written count towards the schedule
+            if (log_frame) {
+                for (auto grp = object_instancer_.begin(); grp != object_instancer_.end(); ++grp) {
+                    if (log_due_[grp->second.type]) {
+                        log_schedule_.logged(grp->second.type, total_time_);
+                    }
                 }
             }
         }
+        // log staging buffers, same as the neighborhoods
+        if (log_frame) {
+            logger_.prepare_staging(omp_get_max_threads());
+        }
+
+        // every so often, move objects around in memory so the ones in the same cell are next to each other
+        if (reorder_interval_ != 0 && total_steps_ % reorder_interval_ == 0) {
+            object_instancer_.reorder([this](const SimObject* obj) { return grid_.cell_of(obj->get_position()); });
+        }
 
         // sort everything (don't seem to be issues here)
         grid_.sort_objects(object_instancer_);
         // begin a logging frame and log dynamic sim attributes if applicable
-        if (log) {
+        if (log_frame) {
             logger_.queue_begin_frame(total_time_);
-            logger_.queue_log_sim_data(log_dynamic(), true);
+            if (const auto dynamic = log_dynamic(); !dynamic.empty()) {
+                logger_.queue_log_sim_data(dynamic, true);
+            }
         }
 
         // update everyone
-        // iteration is cheap, processing is expensive
-        // so have every thread iterate over the whole list
-        // but only a single thread will access a specific element (single) while the others continue on (nowait)
-        // this has no noticeable performance impact vs parallel vector access
+        // objects only write their own back buffers and read everyone else's front buffers, so no locks are needed
+        // and the result does not depend on the number of threads or the order they get to objects in
+        // neighborhoods differ a lot in size, so objects are handed out in small dynamic chunks
         // worth parallelizing the outer loop? not unless number of object groups is large.
         for (auto grp = object_instancer_.begin(); grp != object_instancer_.end(); ++grp) {
+            auto& objects = grp->second.objects;
+            const size_t n = objects.size();
             // update objects
-            std::list<SimObject*>::iterator it;
-#pragma omp parallel private(it) shared(grp, dt, log) default(none)
+#pragma omp parallel shared(objects, n, dt) default(none)
             {
-                for (it = grp->second.objects.begin(); it != grp->second.objects.end(); ++it) {
-#pragma omp single nowait
-                    {
-                        const auto object = *it;
-                        auto neighborhood = grid_.get_neighborhood(object);
-                        object->update(neighborhood, dt);
-                        if (log) {
-                            logger_.queue_log_object_data(object->type_name(), object->log(), true);
-                        }
-                    }
+                auto& neighborhood = neighborhoods_[omp_get_thread_num()];
+#pragma omp for schedule(dynamic, 64)
+                for (size_t i = 0; i < n; i++) {
+                    const auto object = objects[i];
+                    grid_.get_neighborhood(object, neighborhood);
+                    object->update(neighborhood, dt);
                 }
             }
+            // group-wide stage (e.g. batched inference), once every object in the group is done with its own update
+            if (grp->second.update_batch) {
+                grp->second.update_batch(objects, dt, commands_);
+            }
+        }
+
+        // objects despawned by others go inactive now, so they are removed along with everyone else that did
+        for (auto& commands : commands_) {
+            for (const auto object : commands.despawns_) {
+                object->deactivate();
+            }
+            commands.despawns_.clear();
         }
 
+        // add everything that was spawned during the update (at the end of their groups, so after every survivor)
+        apply_spawns();
+
+        // every object has written its next state to its back buffer, so publish them all
+        // inactive objects are removed and bounds are wrapped (donut world) in the same parallel pass
+        // this has to wait until all groups are done, since any object can read any other object's front buffer
+        object_instancer_.publish(world_size_);
+
         // update gpu
         object_instancer_.update_gpu();
 
+        // log objects once they are published, so positions are wrapped back into the world (which quantized logs rely on)
+        // objects removed this step are already gone, objects spawned this step are logged in the step they were born
+        // every thread appends rows to its own staging buffer, they are all handed to the logger when the frame advances
+        if (log_frame) {
+            for (auto grp = object_instancer_.begin(); grp != object_instancer_.end(); ++grp) {
+                const auto type = grp->second.type;
+                // groups that only appeared through spawns this step weren't asked about, so they wait for the next frame
+                if (type >= log_due_.size() || !log_due_[type]) {
+                    continue;
+                }
+                auto& objects = grp->second.objects;
+                const size_t n = objects.size();
+#pragma omp parallel shared(objects, n, type) default(none)
+                {
+                    auto& rows = logger_.staging_buffer(omp_get_thread_num(), type);
+#pragma omp for schedule(static) nowait
+                    for (size_t i = 0; i < n; i++) {
+                        objects[i]->log_row(rows);
+                    }
+                }
+            }
+        }
+
         // next logging frame
-        if (log) {
+        if (log_frame) {
             logger_.queue_advance_frame();
         }
+
+        if (checkpoint_interval_ != 0 && total_steps_ % checkpoint_interval_ == 0) {
+            checkpoint();
+        }
     }
 
     void Simulation::run() {
+        if (headless_) {
+            run_headless();
+        }
+        else {
+            run_windowed();
+        }
+    }
+
+    void Simulation::run_windowed() {
         // everything is initialized, so we can run right into the main loop
         while (!WindowShouldClose() && (total_time_ < run_for_ || run_for_ == 0)) {
             const float dt = time_step_ == 0 ? GetFrameTime() : time_step_;
@@ -129,6 +411,12 @@ namespace swarmulator {
             DrawText(TextFormat("%zu threads", sim_threads_), 0, 40, 18, DARKGREEN);
             DrawText(TextFormat("%.0f sim time", total_time_), 0, 60, 18, DARKGREEN);
             DrawText(TextFormat("%zu updates", total_steps_), 0, 80, 18, DARKGREEN);
+            if (logger_.initialized()) {
+                const auto st = logger_.stats();
+                DrawText(TextFormat("log queue: %zu tasks, %.1f MB", st.tasks_queued, static_cast<double>(st.bytes_buffered) / (1 << 20)), 0, 100, 18, DARKBLUE);
+                DrawText(TextFormat("log writes: %.0f rows/s, %.1f MB/s", st.rows_per_second(), st.bytes_per_second() / (1 << 20)), 0, 120, 18, DARKBLUE);
+                DrawText(TextFormat("log blocked %.2fs, dropped %zu frames", st.blocked_seconds, st.frames_dropped), 0, 140, 18, DARKBLUE);
+            }
             EndDrawing();
         }
 
@@ -137,4 +425,24 @@ namespace swarmulator {
         CloseWindow();
         std::cout << "Average FPS: " << fps << std::endl;
     }
+
+    void Simulation::run_headless() {
+        // there is no frame time to fall back on without a window
+        if (time_step_ <= 0) {
+            throw std::runtime_error("Headless simulations need a fixed time step.");
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        // runs restored from a checkpoint start out with steps already on the clock, only count the ones taken here
+        const size_t start_steps = total_steps_;
+        // no input, no camera, no drawing - just update until we're out of time
+        while (total_time_ < run_for_ || run_for_ == 0) {
+            update(static_cast<float>(time_step_), logger_.initialized());
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const size_t steps = total_steps_ - start_steps;
+
+        std::cout << steps << " steps in " << elapsed.count() << "s" << std::endl;
+        std::cout << "Average steps/sec: " << static_cast<double>(steps) / elapsed.count() << std::endl;
+    }
 } // swarmulator
\ No newline at end of file
@@ -7,6 +7,8 @@
 
 #include "ObjectInstancer.h"
 #include "StaticGrid.h"
+#include "checkpoint/CheckpointWriter.h"
+#include "logger/LogSchedule.h"
 #include "logger/Logger.h"
 
 namespace swarmulator {
@@ -24,6 +26,26 @@ protected:
     ObjectInstancer object_instancer_;
     // and a logger
     Logger logger_;
+    // which object types get logged on which update
+    LogSchedule log_schedule_;
+    // is each type (by type id) being logged on the current update
+    std::vector<uint8_t> log_due_;
+    // one reusable neighborhood buffer per thread, so neighbor queries don't allocate
+    std::vector<Neighborhood> neighborhoods_;
+    // one command buffer per thread, for spawns and despawns asked for during the update (reached through the neighborhoods)
+    std::vector<CommandBuffer> commands_;
+    // spawns of all threads, gathered to be applied in order (reused between updates)
+    std::vector<CommandBuffer::spawn_command> spawns_;
+    // spawns per type (by type id), added to their group and logged in one batch each
+    struct spawn_batch {
+        std::vector<const SimObject*> objects;
+        std::vector<size_t> ids;
+        std::vector<float> genomes;
+    };
+    std::vector<spawn_batch> spawn_batches_;
+    // checkpoints are packed here and written out by their own thread
+    std::unique_ptr<CheckpointWriter> checkpoint_writer_;
+    std::vector<char> checkpoint_blob_; // reused between checkpoints
 
     // how much simulation time to run for (0 for endless)
     double run_for_ = 0;
@@ -33,23 +55,40 @@ protected:
     double time_step_ = 0;
     // how many updates have been performed (same as number of frames rendered)
     size_t total_steps_ = 0;
+    // how many updates between physically reordering objects into grid cell order (0 to never reorder)
+    size_t reorder_interval_ = 0;
+    // how many updates between checkpoints (0 for none)
+    size_t checkpoint_interval_ = 0;
     // how many threads the simulation is running on
     size_t sim_threads_;
+    // headless simulations have no window, camera, or render loop
+    bool headless_ = false;
 
     // perform one update
     // dt is the amount of time that has passed since the last update
     // for a realtime simulation, pass GetFrameTime()
     // for a fixed-time simulation, pass a value between 0 and 1
-    // log is true if this update should run the logger as well
+    // log is true if the logger should be asked to run on this update - the log schedule still decides what (if anything) gets written
     void update(float dt, bool log);
+    // add the objects every thread spawned during the update, one batch per type, in order of the objects that spawned them
+    void apply_spawns();
+
+    // main loop for windowed simulations: input, update, draw
+    void run_windowed();
+    // main loop for headless simulations: fixed time step updates, as fast as possible
+    void run_headless();
 
     // log static simulation information - parameters which won't change over time
-    // this is called once after logger initialization, if the logger was initialized
+    // this is called once when logging is enabled
     virtual std::vector<float> log_static() { return {}; };
     // log dynamic simulation information - simulation instance variables which can change
-    // this is called at every log step
+    // this is called at every log frame
     virtual std::vector<float> log_dynamic() { return {}; };
 
+    // save simulation instance variables with a checkpoint, and read back exactly what was saved when restoring one
+    virtual void save_state([[maybe_unused]] state_writer &out) const {}
+    virtual void restore_state([[maybe_unused]] state_reader &in) {}
+
 public:
     // sane defaults, no logger, unlimited runtime
     Simulation();
@@ -57,16 +96,29 @@ public:
     // specify window and world size, still no logger, unlimited runtime
     Simulation(size_t win_w, size_t win_h, Vector3 world_size, size_t grid_divisions);
 
-    // specify window and world size, as well as logger and compression level
-    // total number of log entries must be known for the logger to run
-    // TODO write logging mode constructor
-    Simulation(size_t win_w, size_t win_h, Vector3 world_size, size_t grid_divisions, std::string& logfile_path, size_t log_compression, size_t log_interval_);
-
-    // Simulation(const Vector3 world_size, const int grid_divisions, const std::string& log_path, const size_t
-    // max_steps);
+    // headless: no window and no rendering, specify world size only, no logger, unlimited runtime
+    // headless simulations must be given a fixed time step before running
+    Simulation(Vector3 world_size, size_t grid_divisions);
 
     virtual ~Simulation() = default;
 
+    // log to an hdf5 file from here on
+    // has to be called before any object types are added, so their tables can be set up
+    // total number of log frames must be known for the logger to run - get it from the schedule (log_schedule().max_frames) once that's set up
+    void enable_logging(const std::string &path, const log_options &options, size_t max_frames);
+
+    // keep appending to an existing log, when restarting from a checkpoint
+    // same rules as enable_logging, and the log options have to match the ones the log was created with
+    // the log is cut back to where the checkpoint was taken once it is restored
+    void resume_logging(const std::string &path, const log_options &options);
+
+    // log schedule: every type logs at the default cadence unless it was given its own, and bursts log everything
+    void set_log_cadence(const log_cadence &cadence) { log_schedule_.set_default(cadence); }
+    template<class T>
+    void set_log_cadence(const log_cadence &cadence) { log_schedule_.set(type_id<T>(), cadence); }
+    void add_log_burst(const double start, const double end) { log_schedule_.add_burst(start, end); }
+    [[nodiscard]] const LogSchedule& log_schedule() const { return log_schedule_; }
+
     // add a new simobject type to the simulation
     // associate it with a mesh as well as vertex and fragment shaders
     // set up its tables in the logger and log its static data, if the simulation was set up to log
@@ -77,23 +129,47 @@ public:
         if (logger_.initialized()) {
             auto dummy = T();
             auto sl = dummy.static_log();
-            logger_.create_object_group(dummy.type_name(), dummy.log().size(), sl.size());
-            logger_.queue_log_object_data(dummy.type_name(), sl, false);
+            // resumed logs already have the static data of the types they know
+            if (logger_.create_object_group(type_id<T>(), dummy.type_name(), dummy.log().size(), sl.size(), dummy.genome_log().size(), dummy.log_ranges(world_size_))) {
+                logger_.queue_log_object_data(type_id<T>(), sl, false);
+            }
         }
     }
 
     // add a simobject of a registered type to the simulation
     // the object passed is copied, and management is taken over by the instancer
-    // if the simulation was set up to log, also logs object addition
+    // if the simulation was set up to log, also logs object addition (and the object's genome)
     template<class T>
     void add_object(const T& obj) {
-        object_instancer_.add_object(obj);
+        const auto managed = object_instancer_.add_object(obj);
+        managed->set_position(wrap_position(managed->get_position(), world_size_));
 
         if (logger_.initialized()) {
-            logger_.queue_new_object(obj.type_name(), obj.get_id());
+            logger_.queue_new_object(type_id<T>(), managed->get_id(), managed->genome_log());
         }
     }
 
+    // how much simulation time to run for (0 for endless)
+    void set_run_for(const double run_for) { run_for_ = run_for; }
+    // how much time passes per update (0 for real time, not allowed when headless)
+    void set_time_step(const double time_step) { time_step_ = time_step; }
+
+    // reorder objects in memory by grid cell every so many updates (0 to never reorder)
+    // keeps objects that are close in space close in memory as well, which helps the neighbor loops once populations get large
+    void set_reorder_interval(const size_t reorder_interval) { reorder_interval_ = reorder_interval; }
+
+    // write a checkpoint to path every so many updates (0 for never)
+    // every checkpoint replaces the last one, and is written in the background
+    void enable_checkpoints(const std::string &path, size_t interval);
+    // write a checkpoint now, between updates: all objects, object ids, sim time and steps, rng and log position
+    void checkpoint();
+    // pick a run back up from a checkpoint, instead of adding objects
+    // the simulation has to be set up like the one that wrote the checkpoint: same world, same object types (registered already)
+    // and if it should keep logging, resume_logging first
+    void restore(const std::string &path);
+
+    [[nodiscard]] bool headless() const { return headless_; }
+
     // start running the simulation
     void run();
 };
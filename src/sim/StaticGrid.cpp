@@ -4,118 +4,237 @@
 
 #include "StaticGrid.h"
 
+#include <omp.h>
+
 namespace swarmulator {
+    namespace {
+        // spread the lower 10 bits of v out so there are two zero bits between each (for 3d morton keys)
+        int spread_bits(unsigned int v) {
+            v &= 0x3ff;
+            v = (v | (v << 16)) & 0x030000ff;
+            v = (v | (v << 8)) & 0x0300f00f;
+            v = (v | (v << 4)) & 0x030c30c3;
+            v = (v | (v << 2)) & 0x09249249;
+            return static_cast<int>(v);
+        }
+    }
+
+    StaticGrid::StaticGrid(const Vector3 world_size, const size_t subdivisions, const cell_order order) :
+        world_size_(world_size), cell_size_(world_size / static_cast<double>(subdivisions)), axis_cell_count_(subdivisions), order_(order) {
+        if (order_ == cell_order::morton && subdivisions > 1024) {
+            throw std::runtime_error("Morton cell order supports at most 1024 subdivisions per axis.");
+        }
+
+        x_keys_.resize(axis_cell_count_);
+        y_keys_.resize(axis_cell_count_);
+        z_keys_.resize(axis_cell_count_);
+        for (int i = 0; i < axis_cell_count_; i++) {
+            if (order_ == cell_order::morton) {
+                // bits never overlap between axes, so adding the parts is the same as or-ing them
+                x_keys_[i] = spread_bits(i) << 2;
+                y_keys_[i] = spread_bits(i) << 1;
+                z_keys_[i] = spread_bits(i);
+            }
+            else {
+                x_keys_[i] = i * axis_cell_count_ * axis_cell_count_;
+                y_keys_[i] = i * axis_cell_count_;
+                z_keys_[i] = i;
+            }
+        }
+        // the last cell has the largest index in both orders
+        total_cell_count_ = cell_index(axis_cell_count_ - 1, axis_cell_count_ - 1, axis_cell_count_ - 1) + 1;
+    }
+
     [[nodiscard]] int StaticGrid::cell_index(const Vector3 pos_grid) const {
         if (pos_grid.x < 0 || pos_grid.y < 0 || pos_grid.z < 0 || pos_grid.x >= world_size_.x || pos_grid.y >= world_size_.y || pos_grid.z >= world_size_.z) {
             return -1;
         }
-        const auto [x, y, z] = floorv3(pos_grid / cell_size_);
-        const int xpart = axis_cell_count_ * axis_cell_count_ * static_cast<int>(x);
-        const int ypart = axis_cell_count_ * static_cast<int>(y);
-        const int zpart = static_cast<int>(z);
-        return xpart + ypart + zpart;
+        const auto [x, y, z] = cell_coords(pos_grid);
+        return cell_index(x, y, z);
     }
 
-    // get the 1d cell index of a given grid space position, and the indices of all cells surrounding that cell in a given radius
-    // wraps the neighborhoods around the world boundaries (toroidal world)
-    [[nodiscard]] std::vector<int> StaticGrid::neighborhood_indices(const Vector3 &pos_grid, const float neighborhood_radius) const {
-        std::vector<int> indices;
-        // offsets are pos_grid - radius, pos_grid + radius
-        for (int x = -neighborhood_radius; x <= neighborhood_radius; x += cell_size_.x) {
-            for (int y = -neighborhood_radius; y <= neighborhood_radius; y += cell_size_.y) {
-                for (int z = -neighborhood_radius; z <= neighborhood_radius; z += cell_size_.z) {
-                    auto offset = Vector3(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
-                    auto op = pos_grid + offset;
-                    op.x = wrap(op.x, world_size_.x);
-                    op.y = wrap(op.y, world_size_.y);
-                    op.z = wrap(op.z, world_size_.z);
-                    if (auto index = cell_index(op); index != -1) {
-                        indices.push_back(index);
-                    }
-                }
+    const StaticGrid::stencil& StaticGrid::stencil_for(const float radius) {
+        if (const auto existing = find_stencil(radius); existing != nullptr) {
+            return *existing;
+        }
+
+        // every point within the radius of some point in a cell lies at most ceil(radius / cell size) cells away
+        // if that reaches all the way around the world, just take every cell along the axis once
+        const auto axis_offsets = [&](const float cell_size) {
+            std::vector<int> offsets;
+            const int reach = static_cast<int>(std::ceil(radius / cell_size));
+            if (2 * reach + 1 >= axis_cell_count_) {
+                for (int o = 0; o < axis_cell_count_; o++) offsets.push_back(o);
+            }
+            else {
+                for (int o = -reach; o <= reach; o++) offsets.push_back(o);
+            }
+            return offsets;
+        };
+
+        stencils_.push_back({radius, axis_offsets(cell_size_.x), axis_offsets(cell_size_.y), axis_offsets(cell_size_.z)});
+        return stencils_.back();
+    }
+
+    const StaticGrid::stencil* StaticGrid::find_stencil(const float radius) const {
+        for (const auto& st : stencils_) {
+            if (st.radius == radius) {
+                return &st;
             }
         }
-        return indices;
+        return nullptr;
     }
 
-    [[nodiscard]] std::vector<int> StaticGrid::neighborhood_indices(const Vector3 &pos_grid) const {
-        std::vector<int> indices;
-        indices.reserve(3 * 3 * 3);
-        const int csix = static_cast<int>(cell_size_.x);
-        const int csiy = static_cast<int>(cell_size_.y);
-        const int csiz = static_cast<int>(cell_size_.z);
-        // KILL BUG!!!!! (see williamdeneen.com) (bug is killed, this is the gravestone)
-        for (int x = -csix; x <= csix; x += csix) {
-            for (int y = -csiy; y <= csiy; y += csiy) {
-                for (int z = -csiz; z <= csiz; z += csiz) {
-                    auto offset = Vector3(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
-                    if (auto index = cell_index(pos_grid + offset); index != -1) {
-                        indices.push_back(index);
-                    }
+    // get the 1d cell indices of all cells around a given grid space position covered by a stencil
+    // wraps the neighborhoods around the world boundaries (toroidal world)
+    void StaticGrid::neighborhood_indices(const Vector3 &pos_grid, const stencil &st, std::vector<int> &out) const {
+        const auto [cx, cy, cz] = cell_coords(pos_grid);
+        // table lookups and integer adds only
+        for (const int ox : st.x) {
+            const int x = wrap_cell(cx + ox);
+            for (const int oy : st.y) {
+                const int y = wrap_cell(cy + oy);
+                for (const int oz : st.z) {
+                    out.push_back(cell_index(x, y, wrap_cell(cz + oz)));
                 }
             }
         }
-        return indices;
     }
 
     void StaticGrid::sort_objects(ObjectInstancer &in) {
-        // nothing wrong in here. not sure why boids are attracted to the center!!
-        sorted = std::vector<SimObject*>(in.size());
-        segment_start = std::vector<uint32_t>(total_cell_count_, 0);
-        segment_length = std::vector<uint32_t>(total_cell_count_, 0);
-
-        // count the number of agents in each cell
-        // slow with parallel
+        // flatten the groups into one array so threads can split the work by index
+        // this walk is the only serial part left
+        // also make sure we have a neighborhood stencil for every interaction radius, since queries can't add any
+        objects_.clear();
+        positions_.clear();
+        types_.clear();
+        float last_radius = -1;
         for (auto grp = in.begin(); grp != in.end(); ++grp) {
-            for (auto it = grp->second.objects.begin(); it != grp->second.objects.end(); ++it) {
-                const auto obj_ptr = *it;
-                const auto pos_grid = obj_ptr->get_position() + 0.5f * world_size_;
-                if (const auto cell = cell_index(pos_grid); cell != -1) { // only add agents if they're in bounds
-                    ++segment_start[cell];
-                    ++segment_length[cell];
+            const auto& positions = grp->second.columns.positions;
+            positions_.insert(positions_.end(), positions.begin(), positions.end());
+            types_.insert(types_.end(), positions.size(), grp->second.type);
+            for (const auto obj_ptr : grp->second.objects) {
+                objects_.push_back(obj_ptr);
+                if (const auto radius = obj_ptr->get_interaction_radius(); radius != last_radius) {
+                    stencil_for(radius);
+                    last_radius = radius;
                 }
             }
         }
+        const size_t n = objects_.size();
 
-        // compute prefix sum
-        // not really worth the effort to parallelize
-        for (int i = 1; i < total_cell_count_; i++) {
-            segment_start[i] += segment_start[i - 1];
-        }
+        // buffers only ever grow, so after the first few frames none of this allocates
+        object_cells_.resize(n);
+        sorted.resize(n);
+        sorted_positions.resize(n);
+        sorted_types.resize(n);
+        segment_start.resize(total_cell_count_);
+        segment_length.resize(total_cell_count_);
+        const auto cells = static_cast<size_t>(total_cell_count_);
+
+#pragma omp parallel default(none) shared(n, cells)
+        {
+            const size_t t = omp_get_thread_num();
+            const size_t num_threads = omp_get_num_threads();
+#pragma omp single
+            {
+                thread_counts_.resize(num_threads * cells);
+                block_sums_.resize(num_threads + 1);
+            }
+            // implicit barrier after single
+
+            // every thread owns the same contiguous chunk of objects in the counting and the scatter pass
+            // that keeps the sort stable: objects end up in the same order within a cell as they are in the groups
+            const size_t obj_begin = n * t / num_threads;
+            const size_t obj_end = n * (t + 1) / num_threads;
+            uint32_t* counts = thread_counts_.data() + t * cells;
+
+            // count the number of agents in each cell, one histogram per thread
+            std::fill_n(counts, cells, 0);
+            for (size_t i = obj_begin; i < obj_end; i++) {
+                const auto pos_grid = positions_[i] + 0.5f * world_size_;
+                const auto cell = cell_index(pos_grid);
+                object_cells_[i] = cell;
+                if (cell != -1) { // only add agents if they're in bounds
+                    ++counts[cell];
+                }
+            }
+#pragma omp barrier
+
+            // merge the histograms into segment lengths
+            // each thread's count becomes its write offset within the cell, and each thread sums its block of cells for the scan
+            const size_t cell_begin = cells * t / num_threads;
+            const size_t cell_end = cells * (t + 1) / num_threads;
+            uint32_t block_sum = 0;
+            for (size_t c = cell_begin; c < cell_end; c++) {
+                uint32_t length = 0;
+                for (size_t u = 0; u < num_threads; u++) {
+                    const auto count = thread_counts_[u * cells + c];
+                    thread_counts_[u * cells + c] = length;
+                    length += count;
+                }
+                segment_length[c] = length;
+                block_sum += length;
+            }
+            block_sums_[t + 1] = block_sum;
+#pragma omp barrier
+
+            // exclusive scan over the block sums (there's only one per thread, so that part is serial)
+#pragma omp single
+            {
+                block_sums_[0] = 0;
+                for (size_t u = 1; u <= num_threads; u++) {
+                    block_sums_[u] += block_sums_[u - 1];
+                }
+            }
+            // implicit barrier after single
 
-        // sort agents into their cells
-        // slow with parallel
-        for (auto rgrp = in.rbegin(); rgrp != in.rend(); ++rgrp) { // careful! need to iterate in reverse here
-            for (auto rit = rgrp->second.objects.rbegin(); rit != rgrp->second.objects.rend(); ++rit) {
-                const auto obj_ptr = *rit;
-                auto pos = obj_ptr->get_position();
-                const auto pos_grid = pos + 0.5f * world_size_;
-                if (const auto cell = cell_index(pos_grid); cell != -1) {
-                    sorted[--segment_start[cell]] = obj_ptr;
+            // exclusive scan within each block of cells
+            uint32_t start = block_sums_[t];
+            for (size_t c = cell_begin; c < cell_end; c++) {
+                segment_start[c] = start;
+                start += segment_length[c];
+            }
+#pragma omp barrier
+
+            // sort agents into their cells
+            for (size_t i = obj_begin; i < obj_end; i++) {
+                if (const auto cell = object_cells_[i]; cell != -1) {
+                    const auto dst = segment_start[cell] + counts[cell]++;
+                    sorted[dst] = objects_[i];
+                    sorted_positions[dst] = positions_[i];
+                    sorted_types[dst] = types_[i];
                 }
             }
         }
     }
 
-    std::list<SimObject *> StaticGrid::get_neighborhood(const SimObject *object) const {
-        auto neighborhood = std::list<SimObject*>();
+    void StaticGrid::get_neighborhood(const SimObject *object, Neighborhood &neighborhood) const {
+        neighborhood.clear();
         const auto object_pos = object->get_position();
         const auto object_pos_grid = object_pos + 0.5f * world_size_;
+        const auto radius_sqr = object->get_interaction_radius() * object->get_interaction_radius();
+
+        const auto st = find_stencil(object->get_interaction_radius());
+        if (st == nullptr) {
+            throw std::runtime_error("No neighborhood stencil for object, was it sorted into the grid?");
+        }
 
         // iterate over every cell in the neighborhood
-        // this is not worth parallelizing - at worst 3^3=27 iterations
-        for (const auto n_i = neighborhood_indices(object_pos_grid, object->get_interaction_radius()); const auto neighborhood_cell : n_i) {
+        // this is not worth parallelizing - usually 3^3=27 iterations
+        neighborhood_indices(object_pos_grid, *st, neighborhood.cells_);
+        for (const auto neighborhood_cell : neighborhood.cells_) {
             // iterate over every agent in the current neighborhood cell
-            for (int i = 0; i < segment_length[neighborhood_cell]; i++) {
-                // add the agent to the neighborhood vector if it isn't the agent we're getting the neighborhood of, and if it's within our interaction radius
-                if (auto neighbor = sorted[segment_start[neighborhood_cell] + i];
-                    neighbor != object &&
-                    Vector3DistanceSqr(neighbor->get_position(), object->get_position()) <= object->get_interaction_radius() * object->get_interaction_radius()) {
-                    neighborhood.push_back(neighbor);
+            const auto start = segment_start[neighborhood_cell];
+            const auto end = start + segment_length[neighborhood_cell];
+            for (auto i = start; i < end; i++) {
+                // add the agent to the neighborhood if it isn't the agent we're getting the neighborhood of, and if it's within our interaction radius
+                if (Vector3DistanceSqr(sorted_positions[i], object_pos) <= radius_sqr && sorted[i] != object) {
+                    neighborhood.objects_.push_back(sorted[i]);
+                    neighborhood.positions_.push_back(sorted_positions[i]);
+                    neighborhood.types_.push_back(sorted_types[i]);
                 }
             }
         }
-
-        return neighborhood;
     }
 }
@@ -6,9 +6,12 @@
 
 #ifndef STATICGRID_H
 #define STATICGRID_H
+#include <array>
+#include <cmath>
 #include <memory>
 #include <vector>
 
+#include "Neighborhood.h"
 #include "ObjectInstancer.h"
 #include "SimObject.h"
 #include "raylib.h"
@@ -19,36 +22,106 @@
 namespace swarmulator {
 
 class StaticGrid {
+public:
+    // how 3d cell coordinates are linearized into 1d cell indices
+    // row_major: x, then y, then z
+    // morton: bits of x, y and z interleaved (z-order curve), so cells close in space are also close in the segment arrays
+    // neighborhoods come out the same either way, only the memory layout changes
+    enum class cell_order { row_major, morton };
+
 private:
     Vector3 world_size_{};
     Vector3 cell_size_{};
     int axis_cell_count_ = 0; // although these are indexes they should stay int because we represent errors in indexing with -1
-    int total_cell_count_ = 0;
+    int total_cell_count_ = 0; // for morton order this includes the unused cells between the ones actually in the grid
+    cell_order order_ = cell_order::morton;
+
+    // per-axis parts of the 1d cell index, so linearizing any cell order is three lookups and two adds
+    std::vector<int> x_keys_ {}, y_keys_ {}, z_keys_ {};
 
     std::vector<SimObject*> sorted {};
+    std::vector<Vector3> sorted_positions {}; // positions of the sorted objects, so distance checks don't have to touch the objects
+    std::vector<type_id_t> sorted_types {}; // type ids of the sorted objects, so neighborhoods can be filtered by type without rtti
     std::vector<uint32_t> segment_start {};
     std::vector<uint32_t> segment_length {};
 
+    // scratch buffers for sorting, kept between frames so they only ever grow
+    std::vector<SimObject*> objects_ {}; // every object in the instancer, flattened
+    std::vector<Vector3> positions_ {}; // positions of the flattened objects, copied from the group columns
+    std::vector<type_id_t> types_ {}; // type ids of the flattened objects
+    std::vector<int> object_cells_ {}; // cell index of every flattened object
+    std::vector<uint32_t> thread_counts_ {}; // one cell histogram per thread, then one write offset per cell per thread
+    std::vector<uint32_t> block_sums_ {}; // exclusive scan of the number of objects in each thread's block of cells
+
+    // precomputed neighborhood offsets for one interaction radius
+    // offsets are in whole cells along each axis, and every cell that could hold a neighbor is covered exactly once
+    struct stencil {
+        float radius;
+        std::vector<int> x, y, z;
+    };
+    // one stencil per distinct interaction radius seen so far (there are usually only a handful)
+    // only added to while sorting, so queries can read them from any thread
+    std::vector<stencil> stencils_ {};
+
+    // integer 3d cell coordinates of a given grid space position
+    // positions outside the grid are wrapped back in (toroidal world)
+    [[nodiscard]] std::array<int, 3> cell_coords(const Vector3 &pos_grid) const {
+        return {
+            wrap_cell(static_cast<int>(std::floor(pos_grid.x / cell_size_.x))),
+            wrap_cell(static_cast<int>(std::floor(pos_grid.y / cell_size_.y))),
+            wrap_cell(static_cast<int>(std::floor(pos_grid.z / cell_size_.z)))
+        };
+    }
+
+    // wrap a cell coordinate along an axis, integer-only
+    // a single add or subtract is enough for the coordinates + stencil offsets we work with, anything else takes the slow path
+    [[nodiscard]] int wrap_cell(int c) const {
+        if (c < 0) c += axis_cell_count_;
+        else if (c >= axis_cell_count_) c -= axis_cell_count_;
+        if (c < 0 || c >= axis_cell_count_) c = ((c % axis_cell_count_) + axis_cell_count_) % axis_cell_count_;
+        return c;
+    }
+
+    // get the 1d cell index of some in-range 3d cell coordinates
+    [[nodiscard]] int cell_index(const int x, const int y, const int z) const {
+        return x_keys_[x] + y_keys_[y] + z_keys_[z];
+    }
+
     // get the 1d cell index of a given grid space position
-    // if the position was out of bounds, wrap it
+    // returns -1 if the position is out of bounds
     [[nodiscard]] int cell_index(Vector3 pos_grid) const;
 
-    // get the 1d cell index of a given grid space position, and the indices of all cells surrounding that cell in a given radius
-    [[nodiscard]] std::vector<int> neighborhood_indices(const Vector3 &pos_grid, float neighborhood_radius) const;
+    // make sure there is a stencil for a given radius, and return it
+    const stencil& stencil_for(float radius);
 
-    // get the 1d cell index of a given grid space position, and the indices of all cells immediately surrounding that cell
-    [[nodiscard]] std::vector<int> neighborhood_indices(const Vector3 &pos_grid) const;
+    // find the stencil for a given radius (nullptr if there is none yet)
+    [[nodiscard]] const stencil* find_stencil(float radius) const;
+
+    // get the 1d cell indices of all cells around a given grid space position covered by a stencil (including its own cell)
+    // indices are appended to out, which is not cleared first
+    void neighborhood_indices(const Vector3 &pos_grid, const stencil &st, std::vector<int> &out) const;
 
 public:
-    StaticGrid(const Vector3 world_size, const size_t subdivisions) : world_size_(world_size), cell_size_(world_size / static_cast<double>(subdivisions)), axis_cell_count_(subdivisions), total_cell_count_(subdivisions * subdivisions * subdivisions) {}
+    StaticGrid(Vector3 world_size, size_t subdivisions, cell_order order = cell_order::morton);
     ~StaticGrid() = default;
 
     // sort all objects in an objectinstancer into the grid
+    // parallel counting sort: per-thread histograms, a parallel exclusive scan over the cells, and a parallel scatter
+    // stable, so objects in a cell keep the order they have in their groups
     void sort_objects(ObjectInstancer &in);
 
     // get all neighbors of a given object (objects within that object's interaction radius)
-    // return does not include object passed
-    [[nodiscard]] std::list<SimObject *> get_neighborhood(const SimObject *object) const;
+    // the object must have been sorted into the grid, so there is a stencil for its radius
+    // the neighborhood passed is cleared and refilled, and does not include the object passed
+    // reuse the same neighborhood across calls (one per thread) and this does not allocate
+    void get_neighborhood(const SimObject *object, Neighborhood &neighborhood) const;
+
+    // 1d index of the cell a global position falls into (wrapped into the world if out of bounds)
+    // useful as a sort key for putting objects into cell order
+    [[nodiscard]] int cell_of(const Vector3 position) const {
+        const auto [x, y, z] = cell_coords(position + 0.5f * world_size_);
+        return cell_index(x, y, z);
+    }
 
     // wrap a global position
     [[nodiscard]] Vector3 wrap_position(const Vector3 position) const {
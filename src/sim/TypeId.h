@@ -0,0 +1,28 @@
+//
+// Created by moltma on 11/4/25.
+//
+
+#ifndef SWARMULATOR_CPP_TYPEID_H
+#define SWARMULATOR_CPP_TYPEID_H
+#include <atomic>
+#include <cstdint>
+
+namespace swarmulator {
+    // small, dense integer ids for simobject types
+    // handed out in order of first use and stable for the lifetime of the process, so they can tag objects in flat arrays
+    // and be compared in inner loops instead of doing rtti
+    using type_id_t = uint16_t;
+
+    inline type_id_t next_type_id() {
+        static std::atomic<type_id_t> next{0};
+        return next++;
+    }
+
+    template<class T>
+    type_id_t type_id() {
+        static const type_id_t id = next_type_id();
+        return id;
+    }
+} // namespace swarmulator
+
+#endif // SWARMULATOR_CPP_TYPEID_H
@@ -0,0 +1,110 @@
+//
+// Created by moltma on 11/12/25.
+//
+
+#include "CheckpointWriter.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace swarmulator {
+    CheckpointWriter::CheckpointWriter(std::string path) : path_(std::move(path)) {
+        worker_thread_ = std::thread(&CheckpointWriter::worker_loop, this);
+    }
+
+    CheckpointWriter::~CheckpointWriter() {
+        {
+            std::lock_guard lock(mutex_);
+            want_exit_ = true; // the worker still finishes whatever was handed over
+        }
+        cv_.notify_all();
+        worker_thread_.join();
+    }
+
+    void CheckpointWriter::write(std::vector<char>& blob, std::function<void()> gate) {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return !has_pending_; });
+        pending_.swap(blob);
+        blob.clear();
+        pending_gate_ = std::move(gate);
+        has_pending_ = true;
+        lock.unlock();
+        cv_.notify_all();
+    }
+
+    void CheckpointWriter::wait() {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return !has_pending_ && !busy_; });
+    }
+
+    size_t CheckpointWriter::written() {
+        std::lock_guard lock(mutex_);
+        return written_;
+    }
+
+    void CheckpointWriter::worker_loop() {
+        while (true) {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return has_pending_ || want_exit_; });
+            if (!has_pending_) {
+                return;
+            }
+            writing_.swap(pending_);
+            writing_gate_ = std::move(pending_gate_);
+            pending_gate_ = {};
+            has_pending_ = false;
+            busy_ = true;
+            lock.unlock();
+            cv_.notify_all(); // room for the next one
+
+            // a failed checkpoint shouldn't take the whole run down with it, the previous one is still there
+            bool ok = true;
+            try {
+                write_file(path_, writing_, writing_gate_);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Checkpoint failed: " << e.what() << std::endl;
+                ok = false;
+            }
+
+            writing_gate_ = {};
+            lock.lock();
+            busy_ = false;
+            written_ += ok;
+            lock.unlock();
+            cv_.notify_all();
+        }
+    }
+
+    void CheckpointWriter::write_file(const std::string& path, const std::vector<char>& blob, const std::function<void()>& gate) {
+        const auto tmp = path + ".tmp";
+        const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open " + tmp + ".");
+        }
+        size_t done = 0;
+        while (done < blob.size()) {
+            const auto n = ::write(fd, blob.data() + done, blob.size() - done);
+            if (n < 0) {
+                close(fd);
+                throw std::runtime_error("Could not write " + tmp + ".");
+            }
+            done += n;
+        }
+        // make sure the data is on disk before the rename makes it the checkpoint
+        if (fsync(fd) != 0) {
+            close(fd);
+            throw std::runtime_error("Could not sync " + tmp + ".");
+        }
+        close(fd);
+        if (gate) {
+            gate();
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Could not rename " + tmp + " to " + path + ".");
+        }
+    }
+} // namespace swarmulator
@@ -0,0 +1,62 @@
+//
+// Created by moltma on 11/12/25.
+//
+
+#ifndef SWARMULATOR_CPP_CHECKPOINTWRITER_H
+#define SWARMULATOR_CPP_CHECKPOINTWRITER_H
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace swarmulator {
+    /*
+     * writes checkpoint blobs to disk in its own thread, so the simulation only pays for packing them
+     * there is at most one checkpoint in flight: handing over a new one while the last is still being written waits for it
+     * (checkpoints are big and spaced out, so if that wait ever shows up the interval is too short)
+     * every checkpoint goes to <path>.tmp first, is synced, and then renamed over <path>
+     * so a crash halfway through a write leaves the previous checkpoint intact
+     * a checkpoint can come with a gate that has to open before the rename (like the log catching up to the checkpoint)
+     * so the previous checkpoint is only replaced once everything the new one refers to is on disk too
+     */
+    class CheckpointWriter {
+    private:
+        std::string path_;
+        std::vector<char> pending_{}; // blob waiting to be written, swapped in by the simulation
+        std::vector<char> writing_{}; // blob being written, owned by the worker
+        std::function<void()> pending_gate_{}; // waited on before renaming the pending blob into place
+        std::function<void()> writing_gate_{};
+        bool has_pending_ = false;
+        bool busy_ = false;
+        bool want_exit_ = false;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::thread worker_thread_;
+
+        size_t written_ = 0; // checkpoints completely written (guarded by mutex_)
+
+        void worker_loop();
+        // write a blob to path, the safe way, waiting on gate (if any) before the rename
+        static void write_file(const std::string& path, const std::vector<char>& blob, const std::function<void()>& gate);
+
+    public:
+        explicit CheckpointWriter(std::string path);
+        ~CheckpointWriter();
+
+        CheckpointWriter(const CheckpointWriter&) = delete;
+        CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+        // hand a blob over to be written, blob is swapped with an old buffer so its memory can be reused for the next checkpoint
+        // gate (optional) is called on the writer thread once the blob is synced, and has to return before it replaces the last checkpoint
+        void write(std::vector<char>& blob, std::function<void()> gate = {});
+        // wait until everything handed over so far is on disk
+        void wait();
+
+        [[nodiscard]] const std::string& path() const { return path_; }
+        [[nodiscard]] size_t written();
+    };
+} // namespace swarmulator
+
+#endif // SWARMULATOR_CPP_CHECKPOINTWRITER_H
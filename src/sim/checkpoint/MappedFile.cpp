@@ -0,0 +1,43 @@
+//
+// Created by moltma on 11/12/25.
+//
+
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace swarmulator {
+    MappedFile::MappedFile(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open " + path + ".");
+        }
+        struct stat st{};
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("Could not stat " + path + ".");
+        }
+        size_ = st.st_size;
+        if (size_ > 0) {
+            void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Could not map " + path + ".");
+            }
+            // objects are restored front to back, so let the os read ahead
+            madvise(mapped, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(mapped);
+        }
+        close(fd); // the mapping keeps the file alive
+    }
+
+    MappedFile::~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+} // namespace swarmulator
@@ -0,0 +1,33 @@
+//
+// Created by moltma on 11/12/25.
+//
+
+#ifndef SWARMULATOR_CPP_MAPPEDFILE_H
+#define SWARMULATOR_CPP_MAPPEDFILE_H
+#include <string>
+
+#include "State.h"
+
+namespace swarmulator {
+    // a whole file mapped read-only into memory
+    // checkpoints are loaded straight out of the mapping, so restoring doesn't read the file into a buffer first
+    // and the os only pages in what is actually touched
+    class MappedFile {
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+
+    public:
+        explicit MappedFile(const std::string& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        [[nodiscard]] const char* data() const { return data_; }
+        [[nodiscard]] size_t size() const { return size_; }
+        [[nodiscard]] state_reader reader() const { return {data_, data_ + size_}; }
+    };
+} // namespace swarmulator
+
+#endif // SWARMULATOR_CPP_MAPPEDFILE_H
@@ -0,0 +1,95 @@
+//
+// Created by moltma on 11/12/25.
+//
+
+#ifndef SWARMULATOR_CPP_STATE_H
+#define SWARMULATOR_CPP_STATE_H
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace swarmulator {
+    // appends raw state to a checkpoint blob
+    // values are stored as their in-memory bytes, so checkpoints only load on the same platform (and build) that wrote them
+    class state_writer {
+    private:
+        std::vector<char>& out_;
+
+    public:
+        explicit state_writer(std::vector<char>& out) : out_(out) {}
+
+        void put_bytes(const void* data, const size_t bytes) {
+            const auto at = out_.size();
+            out_.resize(at + bytes);
+            std::memcpy(out_.data() + at, data, bytes);
+        }
+
+        template<class T>
+        void put(const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be written as raw state");
+            put_bytes(&value, sizeof(T));
+        }
+
+        // n values starting at data (for things like eigen matrices, which aren't trivially copyable themselves)
+        template<class T>
+        void put(const T* data, const size_t n) {
+            static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be written as raw state");
+            put_bytes(data, n * sizeof(T));
+        }
+
+        void put(const std::string& s) {
+            put<uint64_t>(s.size());
+            put(s.data(), s.size());
+        }
+
+        [[nodiscard]] size_t size() const { return out_.size(); }
+    };
+
+    // reads raw state back out of a checkpoint blob, in the order it was written
+    // reading past the end of the blob throws, so a truncated checkpoint can't be half-loaded silently
+    class state_reader {
+    private:
+        const char* at_;
+        const char* end_;
+
+    public:
+        state_reader(const char* begin, const char* end) : at_(begin), end_(end) {}
+
+        void get_bytes(void* data, const size_t bytes) {
+            if (static_cast<size_t>(end_ - at_) < bytes) {
+                throw std::runtime_error("Checkpoint is truncated.");
+            }
+            std::memcpy(data, at_, bytes);
+            at_ += bytes;
+        }
+
+        template<class T>
+        T get() {
+            static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be read as raw state");
+            T value;
+            get_bytes(&value, sizeof(T));
+            return value;
+        }
+
+        template<class T>
+        void get(T& value) { value = get<T>(); }
+
+        template<class T>
+        void get(T* data, const size_t n) {
+            static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be read as raw state");
+            get_bytes(data, n * sizeof(T));
+        }
+
+        std::string get_string() {
+            std::string s(get<uint64_t>(), '\0');
+            get(s.data(), s.size());
+            return s;
+        }
+
+        [[nodiscard]] size_t remaining() const { return end_ - at_; }
+    };
+} // namespace swarmulator
+
+#endif // SWARMULATOR_CPP_STATE_H
@@ -0,0 +1,150 @@
+//
+// Created by moltma on 11/8/25.
+//
+
+#ifndef SWARMULATOR_CPP_LOGSCHEDULE_H
+#define SWARMULATOR_CPP_LOGSCHEDULE_H
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../TypeId.h"
+
+namespace swarmulator {
+    // how often objects of some type get logged
+    // step and time cadences can be combined, the type is logged whenever either one is due
+    struct log_cadence {
+        size_t every_steps = 1; // log every n updates, 0 to not log by update count
+        double every_time = 0; // log every t units of sim time, 0 to not log by sim time
+        bool once = false; // log only at the first log frame after the type shows up, then never again (for things that don't change)
+    };
+
+    // a window of sim time [start, end) in which every type is logged on every update, whatever its cadence says
+    struct log_burst {
+        double start;
+        double end;
+    };
+
+    // what the schedule has done for a type so far, saved with checkpoints
+    struct log_progress {
+        bool logged;
+        int64_t last_time_slot;
+    };
+
+    /*
+     * decides which object types get logged on which update
+     * there is a default cadence for all types, and types can override it
+     * a log frame is only written on updates where at least one type is due, and types that aren't due just get empty segments in that frame
+     * so the index still lines up, and types logged rarely cost nothing on the frames in between
+     */
+    class LogSchedule {
+    private:
+        struct type_state {
+            log_cadence cadence{};
+            bool overridden = false; // false means this type follows the default cadence
+            bool logged = false; // has this type been logged at all yet
+            int64_t last_time_slot = -1; // last every_time slot this type was logged in
+        };
+
+        log_cadence default_cadence_{};
+        std::vector<type_state> types_{}; // by type id
+        std::vector<log_burst> bursts_{};
+
+        type_state& state(const type_id_t type) {
+            if (types_.size() <= type) {
+                types_.resize(type + 1);
+            }
+            return types_[type];
+        }
+
+        [[nodiscard]] bool in_burst(const double time) const {
+            for (const auto& [start, end] : bursts_) {
+                if (time >= start && time < end) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // is a type with this state due at this update? doesn't record anything
+        [[nodiscard]] bool due(const type_state &s, const size_t step, const double time) const {
+            const auto& c = s.overridden ? s.cadence : default_cadence_;
+            if (c.once) {
+                return !s.logged;
+            }
+            if (in_burst(time)) {
+                return true;
+            }
+            if (c.every_steps != 0 && step % c.every_steps == 0) {
+                return true;
+            }
+            return c.every_time > 0 && static_cast<int64_t>(std::floor(time / c.every_time)) > s.last_time_slot;
+        }
+
+    public:
+        void set_default(const log_cadence &cadence) { default_cadence_ = cadence; }
+        void set(const type_id_t type, const log_cadence &cadence) {
+            auto& s = state(type);
+            s.cadence = cadence;
+            s.overridden = true;
+        }
+        void add_burst(const double start, const double end) { bursts_.push_back({start, end}); }
+
+        // should objects of this type be logged on this update? (step counts from 1, time is the sim time after the update)
+        // doesn't record anything, so a frame that ends up not being written (see Logger::admit_frame) doesn't count
+        [[nodiscard]] bool due(const type_id_t type, const size_t step, const double time) const {
+            return type < types_.size() ? due(types_[type], step, time) : due(type_state{}, step, time);
+        }
+
+        // record that objects of this type were logged at this time
+        void logged(const type_id_t type, const double time) {
+            auto& s = state(type);
+            const auto& c = s.overridden ? s.cadence : default_cadence_;
+            s.logged = true;
+            if (c.every_time > 0) {
+                s.last_time_slot = static_cast<int64_t>(std::floor(time / c.every_time));
+            }
+        }
+
+        [[nodiscard]] log_progress progress(const type_id_t type) const {
+            return type < types_.size() ? log_progress{types_[type].logged, types_[type].last_time_slot} : log_progress{false, -1};
+        }
+        void set_progress(const type_id_t type, const log_progress &progress) {
+            auto& s = state(type);
+            s.logged = progress.logged;
+            s.last_time_slot = progress.last_time_slot;
+        }
+
+        // due, and if so, logged
+        bool check(const type_id_t type, const size_t step, const double time) {
+            if (!due(type, step, time)) {
+                return false;
+            }
+            logged(type, time);
+            return true;
+        }
+
+        // upper bound on the number of log frames a run of this many fixed updates will need, for sizing the log file
+        // dry-runs the schedule for the default cadence and every override, as if all of those types were there from the start
+        // types that only show up later (spawned, or added mid-run) can be due on frames this didn't count
+        // the logger turns frames past the bound down instead of failing, so leave some headroom if those matter
+        [[nodiscard]] size_t max_frames(const size_t steps, const double time_step) const {
+            auto dry = *this;
+            // the default cadence stands in for all the types without an override
+            dry.types_.emplace_back();
+            size_t frames = 0;
+            double time = 0;
+            for (size_t step = 1; step <= steps; step++) {
+                time += time_step;
+                bool any = false;
+                for (type_id_t t = 0; t < dry.types_.size(); t++) {
+                    any |= dry.check(t, step, time); // no short circuit, every type has to record its own state
+                }
+                frames += any;
+            }
+            return frames;
+        }
+    };
+} // namespace swarmulator
+
+#endif // SWARMULATOR_CPP_LOGSCHEDULE_H
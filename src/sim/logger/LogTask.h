@@ -4,48 +4,31 @@
 
 #ifndef SWARMULATOR_CPP_LOGTASK_H
 #define SWARMULATOR_CPP_LOGTASK_H
-#include <string>
+#include <cstdint>
 #include <vector>
 
 namespace swarmulator {
-    class LogTask {
-    public:
-        virtual ~LogTask() = default;
-    };
-
-    class BeginFrame final : public LogTask {
-    public:
-        float real_time;
-
-        ~BeginFrame() override = default;
-    };
-
-    class AdvanceFrame final : public LogTask {
-    public:
-        ~AdvanceFrame() override = default;
-    };
-
-    class LogObjectData final : public LogTask {
-    public:
-        bool dynamic;
-        std::string object_type_name;
-        std::vector<float> values;
-
-        ~LogObjectData() override = default;
-    };
-
-    class NewObject final : public LogTask {
-    public:
-        std::string object_type_name;
-        int id;
-    };
-
-    class LogSimData final : public LogTask {
-    public:
-        bool dynamic;
-        std::vector<float> values;
-
-        ~LogSimData() override = default;
+    // one logging task, as it sits in a slot of the logger's task ring
+    // a small tagged header plus a payload vector - tasks are filled in place and the slot is reused, so the payload keeps its capacity between uses
+    struct log_task {
+        enum class kind : uint8_t {
+            begin_frame, // start a new log frame at real_time
+            advance_frame, // finish the current log frame
+            object_data, // a row of object data for group (values, dynamic)
+            object_rows, // a block of dynamic object rows for group, adopted whole from a staging buffer (values)
+            new_object, // object id was added to group (values is its genome, if the group has one)
+            new_objects, // objects ids were added to group (values are their genomes, one after the other, if the group has them)
+            sim_data, // a row of simulation data (values, dynamic)
+            flush, // push everything written so far out to the file (a checkpoint was taken)
+        };
+
+        kind type = kind::advance_frame;
+        bool dynamic = false;
+        uint32_t group = 0; // index of the logger's object group this task is about
+        int id = 0;
+        float real_time = 0;
+        std::vector<float> values{};
+        std::vector<int> ids{};
     };
 }
 
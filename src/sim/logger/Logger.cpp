@@ -4,120 +4,225 @@
 
 #include "Logger.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 namespace swarmulator {
     void Logger::worker_loop() {
-        LogTask* task;
-        while (task_queue_.pop(task)) {
-            if (const auto s = task_queue_.size(); want_exit_ && s % 1024 * 1024 == 0) {
-                std::cout << "\r" << s << " logging tasks left." << std::flush;
+        auto last_report = std::chrono::steady_clock::now();
+        const auto consume = [this](log_task& task) {
+            process(task);
+            bytes_buffered_.fetch_sub(task.values.size() * sizeof(float) + task.ids.size() * sizeof(int), std::memory_order_relaxed);
+            if (task.type == log_task::kind::object_rows) {
+                task.values.clear();
+                const std::lock_guard lock(spare_rows_mutex_);
+                spare_rows_.push_back(std::move(task.values));
+                task.values = {};
+            }
+        };
+        while (task_queue_.pop(consume)) {
+            // while shutting down, report progress a few times a second
+            if (want_exit_ && std::chrono::steady_clock::now() - last_report > std::chrono::milliseconds(250)) {
+                last_report = std::chrono::steady_clock::now();
+                std::cout << "\r" << task_queue_.size() << " logging tasks (" << bytes_buffered_ / (1 << 20) << " MB) left." << std::flush;
             }
+        }
+    }
 
-            // check if our task is to begin a new frame
-            if (const auto begin_frame = dynamic_cast<BeginFrame*>(task); begin_frame != nullptr) {
+    void Logger::process(const log_task &task) {
+        switch (task.type) {
+            // begin a new frame
+            case log_task::kind::begin_frame: {
                 if (frame_id_ >= max_entries_) {
                     throw std::runtime_error("Maximum number of log entries exceeded.");
                 }
 
-                write_frow(frame_id_, {begin_frame->real_time}, sim_time_);
+                write_frow(frame_id_, {task.real_time}, sim_time_);
 
-                for (const auto& [gname, group] : object_groups_) {
-                    if (frame_id_ == 0) {
-                        write_irow(0, {0, 0}, group.index);
-                    }
-                    else {
-                        auto last = read_irow(frame_id_ - 1, group.index);
-                        write_irow(frame_id_, {last[0] + last[1]}, group.index);
-                    }
+                for (auto& group : object_groups_) {
+                    group.frame_rows.clear();
                 }
+                break;
             }
-            // check if our task is to advance to a new frame
-            else if (const auto advance_frame = dynamic_cast<AdvanceFrame*>(task); advance_frame != nullptr) {
+            // advance to a new frame
+            case log_task::kind::advance_frame: {
+                flush_frame();
                 frame_id_++;
+                break;
             }
-            // check if our task is to log some object data
-            else if (const auto log_obj = dynamic_cast<LogObjectData*>(task); log_obj != nullptr) {
-                // if we're logging object dynamic data, do that
-                if (log_obj->dynamic) {
-                    const auto& group = object_groups_[log_obj->object_type_name];
-                    // add the new object log to the dynamic log table
-                    app_frow(log_obj->values, group.state_dynamic);
-                    // update time segment info
-                    auto segment_info = read_irow(frame_id_, group.index); // 0 is segment start, 1 is segment length
-                    segment_info[1]++; // increment segment length
-                    write_irow(frame_id_, segment_info, group.index); // and write back
+            // log some object data
+            case log_task::kind::object_data: {
+                auto& group = object_groups_[task.group];
+                // if we're logging object dynamic data, stage it until the frame is done
+                if (task.dynamic) {
+                    if (group.width != task.values.size()) {
+                        throw std::runtime_error("Invalid dynamic data width.");
+                    }
+                    group.frame_rows.insert(group.frame_rows.end(), task.values.begin(), task.values.end());
                 }
                 // otherwise log static data
                 else {
-                    auto& grp_info = object_groups_[log_obj->object_type_name];
-
                     hsize_t dims[2];
-                    const auto space = grp_info.state_static.getSpace();
+                    const auto space = group.state_static.getSpace();
                     space.getSimpleExtentDims(dims);
-                    if (dims[1] != log_obj->values.size()) {
+                    if (dims[1] != task.values.size()) {
                         throw std::runtime_error("Invalid static data width.");
                     }
 
-                    float data_raw[dims[0]][dims[1]];
-                    for (int i = 0; i < log_obj->values.size(); i++) {
-                        data_raw[0][i] = log_obj->values[i];
+                    group.state_static.write(task.values.data(), H5::PredType::NATIVE_FLOAT);
+                }
+                break;
+            }
+            // adopt a whole block of dynamic object rows
+            case log_task::kind::object_rows: {
+                auto& group = object_groups_[task.group];
+                if (group.width == 0 || task.values.size() % group.width != 0) {
+                    throw std::runtime_error("Invalid dynamic data width.");
+                }
+                group.frame_rows.insert(group.frame_rows.end(), task.values.begin(), task.values.end());
+                break;
+            }
+            // log the creation of a new object
+            case log_task::kind::new_object: {
+                const auto& group = object_groups_[task.group];
+                app_irow({task.id}, group.meta_object);
+                // genome rows line up with object id rows, so every new object of a genome type needs one
+                if (group.genome_width > 0) {
+                    if (task.values.size() != group.genome_width) {
+                        throw std::runtime_error("Invalid genome width.");
                     }
-
-                    grp_info.state_static.write(data_raw, H5::PredType::NATIVE_FLOAT);
+                    app_frows(task.values.data(), 1, group.genome_width, group.meta_genome);
+                    rows_written_.fetch_add(1, std::memory_order_relaxed);
+                    bytes_written_.fetch_add(group.genome_width * sizeof(float), std::memory_order_relaxed);
                 }
+                break;
             }
-            // check if our task is to log the creation of a new object
-            else if (const auto new_obj = dynamic_cast<NewObject*>(task); new_obj != nullptr) {
-                auto& grp_info = object_groups_[new_obj->object_type_name];
-                app_irow({new_obj->id}, grp_info.meta_object);
+            // log the creation of a batch of new objects, one extend and write per table
+            case log_task::kind::new_objects: {
+                const auto& group = object_groups_[task.group];
+                const hsize_t n = task.ids.size();
+                if (n == 0) {
+                    break;
+                }
+                app_rows(task.ids.data(), H5::PredType::NATIVE_INT, n, 1, group.meta_object);
+                if (group.genome_width > 0) {
+                    if (task.values.size() != n * group.genome_width) {
+                        throw std::runtime_error("Invalid genome width.");
+                    }
+                    app_frows(task.values.data(), n, group.genome_width, group.meta_genome);
+                    rows_written_.fetch_add(n, std::memory_order_relaxed);
+                    bytes_written_.fetch_add(task.values.size() * sizeof(float), std::memory_order_relaxed);
+                }
+                break;
             }
-            // check if our task is to log some sim data
-            else if (const auto log_sim = dynamic_cast<LogSimData*>(task); log_sim != nullptr) {
+            // log some sim data
+            case log_task::kind::sim_data: {
                 // if logging dynamic data, just append to dynamic table
-                if (log_sim->dynamic) {
-                    write_frow(frame_id_, log_sim->values, sim_dynamic_);
+                if (task.dynamic) {
+                    write_frow(frame_id_, task.values, sim_dynamic_);
                 }
                 else {
                     hsize_t dims[2];
                     const auto space = sim_static_.getSpace();
                     space.getSimpleExtentDims(dims);
-                    if (dims[1] != log_sim->values.size()) {
+                    if (dims[1] != task.values.size()) {
                         throw std::runtime_error("Invalid static data width.");
                     }
 
-                    float data_raw[dims[0]][dims[1]];
-                    for (int i = 0; i < log_sim->values.size(); i++) {
-                        data_raw[0][i] = log_sim->values[i];
-                    }
-
-                    sim_static_.write(data_raw, H5::PredType::NATIVE_FLOAT);
+                    sim_static_.write(task.values.data(), H5::PredType::NATIVE_FLOAT);
                 }
+                break;
             }
-            else {
-                throw std::runtime_error("Unknown logging task.");
+            // make sure everything so far is in the file, not just in hdf5's caches
+            case log_task::kind::flush: {
+                file_.flush(H5F_SCOPE_GLOBAL);
+                flushes_done_.fetch_add(1, std::memory_order_release);
+                flushes_done_.notify_all();
+                break;
             }
+            default:
+                throw std::runtime_error("Unknown logging task.");
+        }
+    }
 
-            // once we're done we can delete the task
-            delete task;
+    void Logger::flush_frame() {
+        frames_written_.fetch_add(1, std::memory_order_relaxed);
+        for (auto& group : object_groups_) {
+            const hsize_t rows = group.width == 0 ? 0 : group.frame_rows.size() / group.width;
+            // one extend and one write for the whole frame, if there's anything to write
+            if (rows > 0 && group.quantized_columns.empty()) {
+                app_frows(group.frame_rows.data(), rows, group.width, group.state_dynamic);
+            }
+            // with quantized columns, split the rows between the two tables first
+            else if (rows > 0) {
+                group.float_rows.resize(rows * group.float_columns.size());
+                group.quantized_rows.resize(rows * group.quantized_columns.size());
+                for (hsize_t r = 0; r < rows; r++) {
+                    const float* row = group.frame_rows.data() + r * group.width;
+                    float* f = group.float_rows.data() + r * group.float_columns.size();
+                    for (size_t c = 0; c < group.float_columns.size(); c++) {
+                        f[c] = row[group.float_columns[c]];
+                    }
+                    uint16_t* q = group.quantized_rows.data() + r * group.quantized_columns.size();
+                    for (size_t c = 0; c < group.quantized_columns.size(); c++) {
+                        const float stored = std::round((row[group.quantized_columns[c]] - group.offset[c]) / group.scale[c]);
+                        q[c] = static_cast<uint16_t>(std::clamp(stored, 0.f, static_cast<float>(std::numeric_limits<uint16_t>::max())));
+                    }
+                }
+                if (!group.float_columns.empty()) {
+                    app_frows(group.float_rows.data(), rows, group.float_columns.size(), group.state_dynamic);
+                }
+                app_rows(group.quantized_rows.data(), H5::PredType::NATIVE_UINT16, rows, group.quantized_columns.size(), group.state_quantized);
+            }
+            // segment start and length come straight from memory
+            write_irow(frame_id_, {static_cast<int>(group.rows_written), static_cast<int>(rows)}, group.index);
+            group.rows_written += rows;
+            rows_written_.fetch_add(rows, std::memory_order_relaxed);
+            bytes_written_.fetch_add(rows * group.width * sizeof(float), std::memory_order_relaxed);
+            group.frame_rows.clear(); // keeps its capacity for the next frame
         }
     }
 
     void Logger::initialize(const std::string& path, const size_t deflate_level, const size_t max_entries, const size_t static_sim_entry_width, const size_t dynamic_sim_entry_width) {
+        log_options options;
+        options.deflate_level = deflate_level;
+        initialize(path, options, max_entries, static_sim_entry_width, dynamic_sim_entry_width);
+    }
+
+    void Logger::set_options(const log_options &options) {
+        options_ = options;
+        options_.deflate_level = std::min<size_t>(options_.deflate_level, 9);
+        if (options_.chunk_rows == 0) {
+            throw std::runtime_error("Log chunks need at least one row.");
+        }
+        // filters are optional parts of hdf5, so make sure the ones we want were built in
+        if (options_.deflate_level > 0 && !H5Zfilter_avail(H5Z_FILTER_DEFLATE)) {
+            throw std::runtime_error("HDF5 deflate filter is not available.");
+        }
+        if (options_.shuffle && !H5Zfilter_avail(H5Z_FILTER_SHUFFLE)) {
+            throw std::runtime_error("HDF5 shuffle filter is not available.");
+        }
+        if (options_.scale_offset_digits >= 0 && !H5Zfilter_avail(H5Z_FILTER_SCALEOFFSET)) {
+            throw std::runtime_error("HDF5 scale-offset filter is not available.");
+        }
+    }
+
+    void Logger::initialize(const std::string& path, const log_options &options, const size_t max_entries, const size_t static_sim_entry_width, const size_t dynamic_sim_entry_width) {
         if (initialized_) {
             throw std::runtime_error("Logger already initialized.");
         }
-        initialized_ = true;
 
-        if (deflate_level > 9) {
-            compression_level_ = 9;
-        }
-        else {
-            compression_level_ = deflate_level;
-        }
+        set_options(options);
+        initialized_ = true;
 
         max_entries_ = max_entries;
 
         // set up the basic table structure and create the file
-        file_ = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        // the chunk cache is set on the file, so every dataset opened in it gets one of that size
+        H5::FileAccPropList access;
+        access.setCache(0, options_.chunk_cache_slots, options_.chunk_cache_bytes, 0.75);
+        file_ = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, access.getId());
         sim_objects_ = file_.createGroup("objects");
 
         // set up time index table
@@ -140,10 +245,98 @@ namespace swarmulator {
         sim_dynamic_ = file_.createDataSet("dynamic", H5::PredType::NATIVE_FLOAT, space);
 
         // start up the worker loop
+        start_time_ = std::chrono::steady_clock::now();
         worker_thread_ = std::thread(&Logger::worker_loop, this);
         want_exit_ = false;
     }
 
+    void Logger::resume(const std::string& path, const log_options &options) {
+        if (initialized_) {
+            throw std::runtime_error("Logger already initialized.");
+        }
+
+        set_options(options);
+        initialized_ = true;
+        appending_ = true;
+
+        H5::FileAccPropList access;
+        access.setCache(0, options_.chunk_cache_slots, options_.chunk_cache_bytes, 0.75);
+        file_ = H5::H5File(path, H5F_ACC_RDWR, H5::FileCreatPropList::DEFAULT, access);
+        sim_objects_ = file_.openGroup("objects");
+        sim_time_ = file_.openDataSet("time");
+        sim_static_ = file_.openDataSet("static");
+        sim_dynamic_ = file_.openDataSet("dynamic");
+
+        // the frame tables were sized when the log was created, so that's how many frames there are room for
+        hsize_t dims[2];
+        sim_time_.getSpace().getSimpleExtentDims(dims);
+        max_entries_ = dims[0];
+        // these get written again when this run is done
+        for (const auto attr : {"frames_written", "frames_dropped"}) {
+            if (file_.attrExists(attr)) {
+                file_.removeAttr(attr);
+            }
+        }
+
+        start_time_ = std::chrono::steady_clock::now();
+        worker_thread_ = std::thread(&Logger::worker_loop, this);
+        want_exit_ = false;
+    }
+
+    void Logger::rewind(const log_position &position) {
+        init_guard();
+        if (!appending_) {
+            throw std::runtime_error("Only resumed logs can be rewound.");
+        }
+        // the worker is idle as long as nothing was queued, so the file can be touched from here
+        if (task_queue_.size() != 0 || frames_queued_ != 0) {
+            throw std::runtime_error("Logs can only be rewound before anything new was logged.");
+        }
+        if (position.frame > max_entries_) {
+            throw std::runtime_error("Checkpoint is past the end of the log.");
+        }
+
+        // cut every table back to where it was when the checkpoint was taken
+        // anything after that was logged by the run that crashed, and is about to be logged again
+        const auto truncate = [](const H5::DataSet& dataset, const hsize_t rows) {
+            hsize_t dims[2];
+            dataset.getSpace().getSimpleExtentDims(dims);
+            if (dims[0] < rows) {
+                throw std::runtime_error("Log file is behind the checkpoint.");
+            }
+            dims[0] = rows;
+            dataset.extend(dims);
+        };
+        for (const auto& [name, rows, objects] : position.groups) {
+            const auto group_it = std::ranges::find_if(object_groups_, [&](const struct object_group& g) { return g.name == name; });
+            if (group_it == object_groups_.end()) {
+                throw std::runtime_error("Resumed log has no object group " + name + ".");
+            }
+            if (!group_it->float_columns.empty()) {
+                truncate(group_it->state_dynamic, rows);
+            }
+            if (!group_it->quantized_columns.empty()) {
+                truncate(group_it->state_quantized, rows);
+            }
+            truncate(group_it->meta_object, objects);
+            if (group_it->genome_width > 0) {
+                truncate(group_it->meta_genome, objects);
+            }
+            group_it->rows_written = rows;
+            queued_[group_it - object_groups_.begin()] = {rows, objects};
+        }
+        frame_id_ = position.frame;
+        frames_queued_ = position.frame;
+    }
+
+    log_position Logger::position() const {
+        log_position position{frames_queued_, {}};
+        for (size_t g = 0; g < object_groups_.size(); g++) {
+            position.groups.push_back({object_groups_[g].name, queued_[g].rows, queued_[g].objects});
+        }
+        return position;
+    }
+
     Logger::~Logger() {
         // only need to do fancy cleanup if we initialized
         if (initialized_) {
@@ -152,31 +345,201 @@ namespace swarmulator {
             want_exit_ = true; // tell the worker we want to be done
             task_queue_.stop(); // tell the queue there won't be any more things coming in
             worker_thread_.join(); // wait for the worker to finish processing all the accumulated log entries
+
+            // the frame tables are sized up front, so tell readers how many frames actually made it (and how many the budget policy skipped)
+            const auto st = stats();
+            // (frames in the file, which for a resumed log includes the ones from before the restart)
+            const auto frames = static_cast<uint64_t>(frame_id_), dropped = static_cast<uint64_t>(st.frames_dropped);
+            file_.createAttribute("frames_written", H5::PredType::NATIVE_UINT64, H5::DataSpace()).write(H5::PredType::NATIVE_UINT64, &frames);
+            file_.createAttribute("frames_dropped", H5::PredType::NATIVE_UINT64, H5::DataSpace()).write(H5::PredType::NATIVE_UINT64, &dropped);
+
+            std::cout << "\rLogged " << st.frames_written << " frames, " << st.rows_written << " rows, " << st.bytes_written / (1 << 20) << " MB in " << st.seconds << "s ("
+                      << st.rows_per_second() << " rows/s, " << st.bytes_per_second() / (1 << 20) << " MB/s)" << std::endl;
+            std::cout << "Blocked on the logger for " << st.blocked_seconds << "s, dropped " << st.frames_dropped << " frames." << std::endl;
         }
     }
 
-    void Logger::create_object_group(const std::string &name, const size_t object_dynamic_log_width, size_t object_static_log_width) {
+    bool Logger::admit_frame() {
         init_guard();
 
-        if (sim_objects_.exists(name)) {
-            return;
+        // the file was sized for a number of frames (see LogSchedule::max_frames), which types that show up late can outrun
+        if (frames_queued_ >= max_entries_) {
+            ++frames_dropped_;
+            if (!log_full_reported_) {
+                std::cerr << "Log file is full (" << max_entries_ << " frames), dropping further frames." << std::endl;
+                log_full_reported_ = true;
+            }
+            return false;
+        }
+
+        const auto budget = options_.max_buffered_bytes;
+        if (budget == 0) {
+            return true;
+        }
+
+        switch (options_.budget_policy) {
+            case log_budget_policy::block: {
+                if (bytes_buffered_ <= budget) {
+                    return true;
+                }
+                const auto start = std::chrono::steady_clock::now();
+                while (bytes_buffered_ > budget) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                blocked_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                return true;
+            }
+            case log_budget_policy::drop_frames: {
+                if (bytes_buffered_ <= budget) {
+                    return true;
+                }
+                ++frames_dropped_;
+                return false;
+            }
+            case log_budget_policy::degrade: {
+                // only every stride-th frame gets through
+                if (frame_candidates_++ % frame_stride_ != 0) {
+                    ++frames_dropped_;
+                    return false;
+                }
+                // adjust the stride on the frames that do get through
+                if (bytes_buffered_ > budget && frame_stride_ < 1024) {
+                    frame_stride_ *= 2;
+                }
+                else if (bytes_buffered_ < budget / 2 && frame_stride_ > 1) {
+                    frame_stride_ /= 2;
+                }
+                return true;
+            }
+        }
+        return true;
+    }
+
+    log_stats Logger::stats() const {
+        return {
+            task_queue_.size(),
+            bytes_buffered_.load(),
+            rows_written_.load(),
+            bytes_written_.load(),
+            frames_written_.load(),
+            frames_dropped_.load(),
+            frame_stride_,
+            static_cast<double>(blocked_ns_.load()) * 1e-9,
+            initialized_ ? std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_).count() : 0,
+        };
+    }
+
+    bool Logger::create_object_group(const type_id_t type, const std::string &name, const size_t object_dynamic_log_width, size_t object_static_log_width, const size_t object_genome_width, const std::vector<log_range> &ranges) {
+        init_guard();
+
+        if (type < type_groups_.size() && type_groups_[type] >= 0) {
+            return false;
         }
 
-        const auto object_group = sim_objects_.createGroup(name);
         struct object_group mem_group;
+        mem_group.name = name;
+        mem_group.width = object_dynamic_log_width;
+
+        // split the dynamic columns between the float and quantized tables
+        for (uint32_t c = 0; c < object_dynamic_log_width; c++) {
+            const auto range = std::ranges::find_if(ranges, [c](const log_range &r) { return r.column == c; });
+            if (options_.quantize && range != ranges.end() && range->max > range->min) {
+                mem_group.quantized_columns.push_back(c);
+                mem_group.offset.push_back(range->min);
+                mem_group.scale.push_back((range->max - range->min) / std::numeric_limits<uint16_t>::max());
+            }
+            else {
+                mem_group.float_columns.push_back(c);
+            }
+        }
+        const hsize_t float_width = mem_group.float_columns.size();
+        const hsize_t quantized_width = mem_group.quantized_columns.size();
+
+        // a resumed log already has this group's tables, so just pick them back up
+        if (appending_ && sim_objects_.nameExists(name)) {
+            const auto object_group = sim_objects_.openGroup(name);
+            const auto state_group = object_group.openGroup("state");
+            if (state_group.nameExists("dynamic") != (float_width > 0) || state_group.nameExists("quantized") != (quantized_width > 0)) {
+                throw std::runtime_error("Log options don't match the layout of the resumed log for " + name + ".");
+            }
+            if (float_width > 0) {
+                mem_group.state_dynamic = state_group.openDataSet("dynamic");
+            }
+            if (quantized_width > 0) {
+                mem_group.state_quantized = state_group.openDataSet("quantized");
+            }
+            mem_group.state_static = state_group.openDataSet("static");
+            mem_group.index = object_group.openDataSet("index");
+            const auto meta_group = object_group.openGroup("meta");
+            mem_group.meta_object = meta_group.openDataSet("object");
+            if (object_genome_width > 0) {
+                mem_group.meta_genome = meta_group.openDataSet("genome");
+                mem_group.genome_width = object_genome_width;
+            }
+            // picks up appending after whatever is in the file, unless it is rewound to a checkpoint
+            hsize_t dims[2];
+            (float_width > 0 ? mem_group.state_dynamic : mem_group.state_quantized).getSpace().getSimpleExtentDims(dims);
+            mem_group.rows_written = dims[0];
+            add_group(type, std::move(mem_group));
+            return false;
+        }
+
         // create state group
+        const auto object_group = sim_objects_.createGroup(name);
         const auto state_group = object_group.createGroup("state");
         // dynamic state table
-        hsize_t dims[2] = {0, object_dynamic_log_width}; // dims[0] is rows, dims[1] is cols
-        hsize_t maxdims[2] = {H5S_UNLIMITED, object_dynamic_log_width};
+        hsize_t dims[2] = {0, float_width}; // dims[0] is rows, dims[1] is cols
+        hsize_t maxdims[2] = {H5S_UNLIMITED, float_width};
         // because the dynamic table is unlimited, we have to create a proplist and set the chunking
         auto plist = H5::DSetCreatPropList();
-        hsize_t chunk_dims[2] = {chunk_size_, object_dynamic_log_width}; // chunk into however many rows per read
-        plist.setChunk(2, chunk_dims);
+        const auto rows = options_.group_chunk_rows.contains(name) ? options_.group_chunk_rows.at(name) : options_.chunk_rows;
+        hsize_t chunk_dims[2] = {std::max<hsize_t>(rows, 1), float_width}; // chunk into however many rows per read
+        if (float_width > 0) {
+            plist.setChunk(2, chunk_dims);
+        }
         // we also compress the dynamic object logs, since those are the really huge bits
-        plist.setDeflate(compression_level_); // can be 1-9, higher level -> higher compression but slower io. only makes a difference if lots of repetitive rows are logged, or many rows that are partially similar
+        if (options_.scale_offset_digits >= 0) {
+            H5Pset_scaleoffset(plist.getId(), H5Z_SO_FLOAT_DSCALE, options_.scale_offset_digits); // no c++ wrapper for this one
+        }
+        if (options_.shuffle) {
+            plist.setShuffle();
+        }
+        if (options_.deflate_level > 0) {
+            plist.setDeflate(static_cast<int>(options_.deflate_level)); // can be 1-9, higher level -> higher compression but slower io
+        }
         auto space = H5::DataSpace(2, dims, maxdims);
-        const auto dynamic_state = state_group.createDataSet("dynamic", H5::PredType::NATIVE_FLOAT, space, plist);
+        H5::DataSet dynamic_state;
+        if (float_width > 0) { // every column of the row could be quantized
+            dynamic_state = state_group.createDataSet("dynamic", H5::PredType::NATIVE_FLOAT, space, plist);
+        }
+
+        // quantized state table, same rows as the dynamic one
+        // the attributes tell readers where each column came from and how to get the floats back
+        if (quantized_width > 0) {
+            dims[1] = quantized_width;
+            maxdims[1] = quantized_width;
+            chunk_dims[1] = quantized_width;
+            auto qplist = H5::DSetCreatPropList();
+            qplist.setChunk(2, chunk_dims);
+            if (options_.shuffle) {
+                qplist.setShuffle();
+            }
+            if (options_.deflate_level > 0) {
+                qplist.setDeflate(static_cast<int>(options_.deflate_level));
+            }
+            space = H5::DataSpace(2, dims, maxdims);
+            mem_group.state_quantized = state_group.createDataSet("quantized", H5::PredType::STD_U16LE, space, qplist);
+
+            const hsize_t attr_dims[1] = {quantized_width};
+            const auto attr_space = H5::DataSpace(1, attr_dims);
+            mem_group.state_quantized.createAttribute("columns", H5::PredType::NATIVE_UINT32, attr_space).write(H5::PredType::NATIVE_UINT32, mem_group.quantized_columns.data());
+            mem_group.state_quantized.createAttribute("scale", H5::PredType::NATIVE_FLOAT, attr_space).write(H5::PredType::NATIVE_FLOAT, mem_group.scale.data());
+            mem_group.state_quantized.createAttribute("offset", H5::PredType::NATIVE_FLOAT, attr_space).write(H5::PredType::NATIVE_FLOAT, mem_group.offset.data());
+            if (float_width > 0) {
+                const hsize_t float_attr_dims[1] = {float_width};
+                dynamic_state.createAttribute("columns", H5::PredType::NATIVE_UINT32, H5::DataSpace(1, float_attr_dims)).write(H5::PredType::NATIVE_UINT32, mem_group.float_columns.data());
+            }
+        }
 
         // static state table
         dims[0] = 1; // these are parameters that do not change for this object group, so we only need one row
@@ -199,57 +562,168 @@ namespace swarmulator {
         maxdims[1] = 1;
         space = H5::DataSpace(2, dims, maxdims);
         plist = H5::DSetCreatPropList();
-        chunk_dims[0] = chunk_size_;
+        chunk_dims[0] = options_.chunk_rows;
         chunk_dims[1] = 1;
         plist.setChunk(2, chunk_dims);
         const auto object_ids = meta_group.createDataSet("object", H5::PredType::NATIVE_INT, space, plist);
 
+        // genome table, written once per object at birth
+        // compressed like the dynamic tables, but not scale-offset - genomes should come back exactly
+        if (object_genome_width > 0) {
+            dims[1] = object_genome_width;
+            maxdims[1] = object_genome_width;
+            space = H5::DataSpace(2, dims, maxdims);
+            plist = H5::DSetCreatPropList();
+            chunk_dims[1] = object_genome_width;
+            plist.setChunk(2, chunk_dims);
+            if (options_.shuffle) {
+                plist.setShuffle();
+            }
+            if (options_.deflate_level > 0) {
+                plist.setDeflate(static_cast<int>(options_.deflate_level));
+            }
+            mem_group.meta_genome = meta_group.createDataSet("genome", H5::PredType::NATIVE_FLOAT, space, plist);
+            mem_group.genome_width = object_genome_width;
+        }
+
         mem_group.state_dynamic = dynamic_state;
         mem_group.state_static = static_state;
         mem_group.index = time_idx;
         mem_group.meta_object = object_ids;
-        object_groups_.insert(std::make_pair(name, mem_group));
+        add_group(type, std::move(mem_group));
+        return true;
+    }
+
+    void Logger::add_group(const type_id_t type, struct object_group &&group) {
+        if (type_groups_.size() <= type) {
+            type_groups_.resize(type + 1, -1);
+        }
+        type_groups_[type] = static_cast<int32_t>(object_groups_.size());
+        object_groups_.push_back(std::move(group));
+        // the sim-side position starts out wherever the tables end (nowhere, unless the log was resumed)
+        hsize_t dims[2];
+        object_groups_.back().meta_object.getSpace().getSimpleExtentDims(dims);
+        queued_.push_back({object_groups_.back().rows_written, dims[0]});
+        // every thread gets a staging buffer for the new group
+        for (auto& stage : staging_) {
+            stage.resize(object_groups_.size());
+        }
     }
 
     void Logger::queue_begin_frame(const float real_time) {
         init_guard();
 
-        const auto task = new BeginFrame();
-        task->real_time = real_time;
-        task_queue_.push(task);
+        push([&](log_task& task) {
+            task.type = log_task::kind::begin_frame;
+            task.real_time = real_time;
+        });
     }
 
     void Logger::queue_advance_frame() {
         init_guard();
 
-        task_queue_.push(new AdvanceFrame());
+        // hand every non-empty staging buffer over to the worker
+        // buffers are swapped with the task payloads instead of copied, and the stage gets a buffer the worker is done with in return
+        for (auto& stage : staging_) {
+            for (uint32_t group = 0; group < stage.size(); group++) {
+                if (stage[group].empty()) {
+                    continue;
+                }
+                queued_[group].rows += stage[group].size() / object_groups_[group].width;
+                push([&](log_task& task) {
+                    task.type = log_task::kind::object_rows;
+                    task.group = group;
+                    task.values.swap(stage[group]);
+                });
+                stage[group].clear();
+                const std::lock_guard lock(spare_rows_mutex_);
+                if (!spare_rows_.empty()) {
+                    stage[group].swap(spare_rows_.back());
+                    spare_rows_.pop_back();
+                }
+            }
+        }
+
+        // the worker hands back every buffer the stages ever sent, including the extra ones from while it was behind
+        // the stages only ever need one each, so let go of the rest
+        {
+            const std::lock_guard lock(spare_rows_mutex_);
+            const size_t stages = staging_.size() * object_groups_.size();
+            if (spare_rows_.size() > stages) {
+                spare_rows_.resize(stages);
+            }
+        }
+
+        push([](log_task& task) { task.type = log_task::kind::advance_frame; });
+        ++frames_queued_;
+    }
+
+    uint64_t Logger::queue_flush() {
+        init_guard();
+
+        push([](log_task& task) { task.type = log_task::kind::flush; });
+        return ++flushes_queued_;
+    }
+
+    void Logger::wait_flushed(const uint64_t ticket) const {
+        for (auto done = flushes_done_.load(std::memory_order_acquire); done < ticket; done = flushes_done_.load(std::memory_order_acquire)) {
+            flushes_done_.wait(done, std::memory_order_acquire);
+        }
+    }
+
+    void Logger::prepare_staging(const size_t threads) {
+        if (staging_.size() < threads) {
+            staging_.resize(threads, std::vector<std::vector<float>>(object_groups_.size()));
+        }
+    }
+
+    void Logger::queue_log_object_data(const type_id_t type, const std::vector<float> &vals, const bool dynamic) {
+        init_guard();
+
+        const auto group = group_id(type);
+        queued_[group].rows += dynamic;
+        push([&](log_task& task) {
+            task.type = log_task::kind::object_data;
+            task.group = group;
+            task.dynamic = dynamic;
+            task.values.assign(vals.begin(), vals.end()); // reuses the slot's payload memory
+        });
     }
 
-    void Logger::queue_log_object_data(const std::string &object_type_name, const std::vector<float> &vals, const bool dynamic) {
+    void Logger::queue_new_object(const type_id_t type, const size_t id, const std::vector<float> &genome) {
         init_guard();
 
-        const auto task = new LogObjectData();
-        task->object_type_name = object_type_name;
-        task->values = vals;
-        task->dynamic = dynamic;
-        task_queue_.push(task);
+        const auto group = group_id(type);
+        ++queued_[group].objects;
+        push([&](log_task& task) {
+            task.type = log_task::kind::new_object;
+            task.group = group;
+            task.id = static_cast<int>(id);
+            task.values.assign(genome.begin(), genome.end());
+        });
     }
 
-    void Logger::queue_new_object(const std::string &object_type_name, const size_t id) {
+    void Logger::queue_new_objects(const type_id_t type, const std::vector<size_t> &ids, const std::vector<float> &genomes) {
         init_guard();
 
-        const auto task = new NewObject();
-        task->object_type_name = object_type_name;
-        task->id = static_cast<int>(id);
-        task_queue_.push(task);
+        const auto group = group_id(type);
+        queued_[group].objects += ids.size();
+        push([&](log_task& task) {
+            task.type = log_task::kind::new_objects;
+            task.group = group;
+            task.ids.resize(ids.size());
+            std::ranges::transform(ids, task.ids.begin(), [](const size_t id) { return static_cast<int>(id); });
+            task.values.assign(genomes.begin(), genomes.end());
+        });
     }
 
-    void Logger::queue_log_sim_data(std::vector<float> vals, bool dynamic) {
+    void Logger::queue_log_sim_data(const std::vector<float> &vals, const bool dynamic) {
         init_guard();
 
-        const auto task = new LogSimData();
-        task->values = vals;
-        task->dynamic = dynamic;
-        task_queue_.push(task);
+        push([&](log_task& task) {
+            task.type = log_task::kind::sim_data;
+            task.dynamic = dynamic;
+            task.values.assign(vals.begin(), vals.end());
+        });
     }
 } // namespace swarmulator
@@ -6,15 +6,79 @@
 #define SWARMULATOR_CPP_LOGGER_H
 #include <H5Cpp.h>
 #include <atomic>
+#include <chrono>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "../SimObject.h"
+#include "../TypeId.h"
 #include "LogTask.h"
-#include "ThreadsafeQueue.h"
+#include "MpscRing.h"
 
 namespace swarmulator {
+    // what to do about a new log frame while more than the byte budget is waiting to be written
+    enum class log_budget_policy {
+        block, // wait for the logger to catch up (the simulation slows down, nothing is lost)
+        drop_frames, // skip the frame
+        degrade, // only write every nth frame, doubling n while over budget and halving it again once the logger has caught up
+    };
+
+    // how the logger lays out and compresses the big dynamic object tables
+    // filters run in the order listed here (scale-offset, then shuffle, then deflate)
+    // good starting points: shuffle + deflate 1 for lossless logs, add scale-offset when a few decimals are enough
+    struct log_options {
+        // lossy: round floats to this many decimal digits and store them as packed integers (hdf5 scale-offset filter), -1 to keep full precision
+        int scale_offset_digits = -1;
+        // byte-shuffle floats before deflating, so the slowly changing exponent and high mantissa bytes end up next to each other
+        bool shuffle = false;
+        // 0 (off) to 9, higher levels compress a little better but get slow fast
+        size_t deflate_level = 0;
+        // rows per chunk in the dynamic tables, and overrides for specific groups by type name
+        // bigger chunks compress better, but every chunk written to has to fit in the chunk cache
+        size_t chunk_rows = 1024;
+        std::map<std::string, size_t> group_chunk_rows{};
+        // store dynamic columns with a known range (see SimObject::log_ranges) as 16 bit fixed point in state/quantized instead of floats
+        bool quantize = false;
+        // how much log data may wait in the queue before the budget policy kicks in, 0 for no budget
+        size_t max_buffered_bytes = 0;
+        log_budget_policy budget_policy = log_budget_policy::block;
+        // hdf5 raw data chunk cache per open dataset
+        size_t chunk_cache_bytes = 1 << 20;
+        size_t chunk_cache_slots = 521; // number of hash slots, a prime somewhere near 10x the chunks that fit in the cache
+    };
+
+    // what the logger has been up to (see Logger::stats)
+    struct log_stats {
+        size_t tasks_queued; // tasks waiting for the worker
+        size_t bytes_buffered; // payload bytes waiting for the worker
+        size_t rows_written; // object rows handed to hdf5 (dynamic and genome)
+        size_t bytes_written; // uncompressed bytes of those rows
+        size_t frames_written;
+        size_t frames_dropped; // frames skipped by the budget policy
+        size_t frame_stride; // only every nth frame is written (degrade policy)
+        double blocked_seconds; // time the simulation spent waiting on the logger
+        double seconds; // time since the logger was initialized
+
+        [[nodiscard]] double rows_per_second() const { return seconds > 0 ? static_cast<double>(rows_written) / seconds : 0; }
+        [[nodiscard]] double bytes_per_second() const { return seconds > 0 ? static_cast<double>(bytes_written) / seconds : 0; }
+    };
+
+    // how far a log has gotten, as far as the simulation is concerned (everything queued counts, written or not)
+    // saved with checkpoints, so a resumed log can be cut back to exactly where the checkpoint was taken
+    struct log_position {
+        struct group {
+            std::string name;
+            uint64_t rows; // rows in the dynamic state table
+            uint64_t objects; // rows in meta/object (and meta/genome)
+        };
+
+        uint64_t frame; // next frame id
+        std::vector<group> groups;
+    };
+
     /*
      * what does the logger have to do?
      * - manage creation and access of the log tables in a threadsafe way
@@ -28,10 +92,13 @@ namespace swarmulator {
      * |    |- <object type name>
      * |        |- state
      * |        |    |- dynamic -> <table mapping log id to object id, pos_x, pos_y, pos_z, etc. all entries collected at a given time must be contiguous>
+     * |        |    |- quantized -> <only if some columns are quantized: those columns as uint16, value = offset + stored * scale. same rows as dynamic>
+     * |        |    |               <attributes columns, scale, offset on quantized; columns on dynamic - which columns of the original row each table holds>
      * |        |    |- static -> <table with simobject params that were static throughout the simulation>
      * |        |- index -> <table mapping log ids to their starting positions and segment lengths in the state table>
      * |        |- meta
      * |            |- object -> <list of all unique object ids used for this type>
+     * |            |- genome -> <per-object parameters that are fixed at birth (e.g. brain weights), row i belongs to the object in row i of object. only for types with a genome>
      * |- static -> <table of simulation parameters which did not change over time>
      * |- dynamic -> <table of simulation parameters which changed over time>
      * |- time -> <table mapping log ids to simulation times>
@@ -41,20 +108,48 @@ namespace swarmulator {
      * also!
      * the logger is based on a worker thread model. writes have to be serialized anyways, so the simulation enqueues logging tasks and the logger, running in its own thread, has plenty of time to get them done serially
      * because we enqueue, order of log entries is preserved
+     * tasks go through a lock-free ring (see MpscRing) and are filled in place, so queueing from inside the parallel update doesn't lock or allocate
      */
     class Logger {
     private:
         struct object_group {
+            std::string name; // type name, which is also the name of its h5 group
             H5::DataSet state_dynamic;
             H5::DataSet state_static;
             H5::DataSet index;
             H5::DataSet meta_object;
+            H5::DataSet meta_genome; // only if genome_width > 0
+            size_t genome_width = 0;
+
+            // dynamic rows are staged here for a whole frame and written out in one go when the frame advances
+            // the index is kept in memory too, so it never has to be read back from the file
+            size_t width = 0; // dynamic row width
+            std::vector<float> frame_rows{}; // this frame's rows, flattened row-major
+
+            // quantized columns, if any: which columns of the row go to the float and the quantized tables
+            H5::DataSet state_quantized;
+            std::vector<uint32_t> float_columns{};
+            std::vector<uint32_t> quantized_columns{};
+            std::vector<float> offset{}, scale{}; // per quantized column
+            std::vector<float> float_rows{}; // scratch for splitting frame rows between the two tables
+            std::vector<uint16_t> quantized_rows{};
+            hsize_t rows_written = 0; // rows in the dynamic state table so far, which is also where this frame's segment starts
         };
 
         H5::H5File file_; // logfile to write to
 
-        // map object type names to their datasets
-        std::map<std::string, object_group> object_groups_; // keeping dataset handles in memory is much faster than querying/opening every time
+        // object groups and their datasets, tasks refer to them by index
+        std::vector<object_group> object_groups_; // keeping dataset handles in memory is much faster than querying/opening every time
+        std::vector<int32_t> type_groups_; // map object type ids to their group index (-1 for types without a group)
+
+        // per-thread staging buffers for dynamic object rows, staging_[thread][group]
+        // threads append rows here during the update, and the whole buffers are handed to the worker when the frame advances
+        std::vector<std::vector<std::vector<float>>> staging_;
+        // row buffers the worker is done with, on their way back to the staging buffers
+        // the worker takes every row payload out of its slot once it is written (a frame's rows shouldn't sit in the ring for a whole lap)
+        // and queue_advance_frame gives them to the stages it just emptied, so payload memory circulates instead of piling up
+        std::mutex spare_rows_mutex_;
+        std::vector<std::vector<float>> spare_rows_;
         H5::Group sim_objects_;
         // simulation properties static table
         H5::DataSet sim_static_;
@@ -65,17 +160,46 @@ namespace swarmulator {
 
         size_t frame_id_ = 0; // current log entry id
 
+        // the same positions, simulation side: counted as tasks are queued instead of written (see position)
+        struct queued_group {
+            uint64_t rows;
+            uint64_t objects;
+        };
+        std::vector<queued_group> queued_; // by group index
+        size_t frames_queued_ = 0;
+        uint64_t flushes_queued_ = 0;
+        std::atomic<uint64_t> flushes_done_{0}; // written by the worker
+
         // stuff for the worker thread model
-        ThreadsafeQueue<LogTask*> task_queue_;
+        static constexpr size_t task_capacity_ = 1 << 16; // tasks that can be queued before queueing blocks - power of 2 please!
+        MpscRing<log_task> task_queue_{task_capacity_};
         std::thread worker_thread_;
         std::atomic<bool> want_exit_;
 
+        // telemetry
+        std::chrono::steady_clock::time_point start_time_{};
+        std::atomic<size_t> bytes_buffered_{0};
+        std::atomic<size_t> rows_written_{0};
+        std::atomic<size_t> bytes_written_{0};
+        std::atomic<size_t> frames_written_{0};
+        std::atomic<size_t> frames_dropped_{0};
+        bool log_full_reported_ = false;
+        std::atomic<int64_t> blocked_ns_{0};
+        // degrade policy state (simulation thread only)
+        size_t frame_stride_ = 1;
+        size_t frame_candidates_ = 0;
+
         // state info
         bool initialized_ = false;
+        bool appending_ = false; // opened an existing log instead of creating one (see resume)
         // parameters
         size_t max_entries_; // knowable since simulation lengths are bounded
-        static constexpr hsize_t chunk_size_ = 1024;
-        size_t compression_level_ = 0; // 0 to 9
+        log_options options_{};
+
+        // validate and adopt log options
+        void set_options(const log_options &options);
+        // register an object group (with its tables already set up) under a type id
+        void add_group(type_id_t type, struct object_group &&group);
 
         // write a row of floats to a known-length dataset
         static void write_frow(const size_t idx, const std::vector<float>& values, const H5::DataSet& dataset) {
@@ -87,23 +211,27 @@ namespace swarmulator {
             dataset.write(values.data(), H5::PredType::NATIVE_FLOAT, memspace, filespace);
         }
 
-        // append a row of floats to an unlimited-length dataset
-        static void app_frow(const std::vector<float>& values, const H5::DataSet& dataset) {
+        // append rows of floats to an unlimited-length dataset, in a single extend and write
+        // values are row-major, rows * width of them
+        static void app_frows(const float* values, const hsize_t rows, const hsize_t width, const H5::DataSet& dataset) {
+            app_rows(values, H5::PredType::NATIVE_FLOAT, rows, width, dataset);
+        }
+
+        // the same for any type of value
+        static void app_rows(const void* values, const H5::PredType& type, const hsize_t rows, const hsize_t width, const H5::DataSet& dataset) {
             hsize_t dims_current[2];
             dataset.getSpace().getSimpleExtentDims(dims_current);
-            hsize_t rows = dims_current[0];
-            hsize_t new_rows = rows + 1;
 
-            hsize_t dims_new[2] = { new_rows, dims_current[1] };
+            hsize_t dims_new[2] = { dims_current[0] + rows, dims_current[1] };
             dataset.extend(dims_new);
 
             const auto filespace = dataset.getSpace();
-            hsize_t offset[2] = { rows, 0, };
-            hsize_t count[2] = { 1, values.size() };
+            hsize_t offset[2] = { dims_current[0], 0, };
+            hsize_t count[2] = { rows, width };
             filespace.selectHyperslab(H5S_SELECT_SET, count, offset);
 
             const auto memspace = H5::DataSpace(2, count);
-            dataset.write(values.data(), H5::PredType::NATIVE_FLOAT, memspace, filespace);
+            dataset.write(values, type, memspace, filespace);
         }
 
         // write a row of integers to a known-length dataset
@@ -135,38 +263,70 @@ namespace swarmulator {
             dataset.write(values.data(), H5::PredType::NATIVE_INT, memspace, filespace);
         }
 
-        // read a row of integers from a dataset
-        static std::vector<int> read_irow(const size_t idx, const H5::DataSet& dataset) {
-            const auto filespace = dataset.getSpace();
-            hsize_t dims[2];
-            filespace.getSimpleExtentDims(dims);
-            const hsize_t offset[2] = {idx, 0};
-            const hsize_t count[2] = {1, dims[1]};
-            filespace.selectHyperslab(H5S_SELECT_SET, count, offset);
-            const auto memspace = H5::DataSpace(2, count);
-            int out[dims[1]];
-            dataset.read(out, H5::PredType::NATIVE_INT, memspace, filespace);
-            return std::vector<int>(out, out+dims[1]);
-        }
+        // write every group's staged rows and its index row for the current frame
+        void flush_frame();
 
         void worker_loop();
 
+        // queue a task, filled in place by fill(log_task&)
+        // keeps track of the bytes queued and of the time spent waiting for room
+        // slots are reused, so their payloads are cleared first (keeping their memory): only what fill writes is queued and counted
+        template<class F>
+        void push(F&& fill) {
+            const auto counted = [&](log_task& task) {
+                task.values.clear();
+                task.ids.clear();
+                fill(task);
+                bytes_buffered_.fetch_add(task.values.size() * sizeof(float) + task.ids.size() * sizeof(int), std::memory_order_relaxed);
+            };
+            if (task_queue_.try_push(counted)) {
+                return;
+            }
+            const auto start = std::chrono::steady_clock::now();
+            task_queue_.push(counted);
+            blocked_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+        // carry out a single task (worker thread only)
+        void process(const log_task &task);
+
         void init_guard() const {
             if (!initialized_) {
                 throw std::runtime_error("Logger was not initialized.");
             }
         }
 
+        [[nodiscard]] uint32_t group_id(const type_id_t type) const {
+            if (type >= type_groups_.size() || type_groups_[type] < 0) {
+                throw std::runtime_error("Logger object group does not exist.");
+            }
+            return type_groups_[type];
+        }
+
     public:
         Logger() = default;
         ~Logger();
 
+        void initialize(const std::string& path, const log_options &options, size_t max_entries, size_t static_sim_entry_width, size_t dynamic_sim_entry_width);
+        // plain deflate at the given level, default layout
         void initialize(const std::string& path, size_t deflate_level, size_t max_entries, size_t static_sim_entry_width, size_t dynamic_sim_entry_width);
 
+        // open an existing log to keep appending to it (after restoring a checkpoint)
+        // the frame tables keep the size they were created with, and object groups are opened instead of created when they are registered
+        // options have to lay the tables out the same way they were when the log was created
+        void resume(const std::string& path, const log_options &options);
+        // cut a resumed log back to a position saved with a checkpoint, dropping whatever was logged after it
+        // only before anything new was queued
+        void rewind(const log_position &position);
+
         // create the h5 group for an object type (state, index, meta subgroups)
+        // the group is named after the type, and tasks refer to it by the type's id
         // does nothing if the group exists
         // also initializes index/time, index/object, meta/object since we already know the shapes of those
-        void create_object_group(const std::string &name, size_t object_dynamic_log_width, size_t object_static_log_width);
+        // and meta/genome, if the type has a genome (genome width > 0)
+        // dynamic columns with a range are quantized if the log options say so
+        // resumed logs open the group's tables instead, if they are there already
+        // returns true if the tables were newly created (and still need their static data)
+        bool create_object_group(type_id_t type, const std::string &name, size_t object_dynamic_log_width, size_t object_static_log_width, size_t object_genome_width = 0, const std::vector<log_range> &ranges = {});
 
         // because the logger runs in its own thread, all you can do is en/dequeue logging tasks
         // task order is preserved
@@ -176,12 +336,39 @@ namespace swarmulator {
         // advance frame (once per update)
         void queue_begin_frame(float real_time);
         void queue_advance_frame();
-        void queue_log_object_data(const std::string &object_type_name, const std::vector<float> &vals, bool dynamic);
-        void queue_new_object(const std::string &object_type_name, size_t id);
-        void queue_log_sim_data(std::vector<float> vals, bool dynamic);
+        void queue_log_object_data(type_id_t type, const std::vector<float> &vals, bool dynamic);
+        // genome goes to meta/genome, leave it empty for types without one
+        void queue_new_object(type_id_t type, size_t id, const std::vector<float> &genome = {});
+        // a whole batch of new objects of one type in one task, genomes one after the other (or empty for types without one)
+        void queue_new_objects(type_id_t type, const std::vector<size_t> &ids, const std::vector<float> &genomes = {});
+
+        // the fast way to log dynamic object data from inside a parallel update:
+        // append rows straight to the calling thread's staging buffer for the object's type
+        // everything staged is queued in one piece per thread and group by queue_advance_frame
+        // make sure there are enough staging buffers for every thread first (outside of the parallel region)
+        void prepare_staging(size_t threads);
+        [[nodiscard]] std::vector<float>& staging_buffer(const size_t thread, const type_id_t type) {
+            return staging_[thread][group_id(type)];
+        }
+        void queue_log_sim_data(const std::vector<float> &vals, bool dynamic);
+        // flush the file once everything queued so far is written
+        // returns a ticket for wait_flushed
+        uint64_t queue_flush();
+        // wait until the flush with the given ticket (and everything queued before it) is on its way to disk
+        // can be called from any thread
+        void wait_flushed(uint64_t ticket) const;
+
+        // ask for permission to write a log frame, before beginning it
+        // applies the byte budget policy: might wait for the worker, or turn the frame down
+        // frames past the end of the log file (max entries) are always turned down, instead of failing the worker later
+        bool admit_frame();
 
-        [[nodiscard]] std::size_t tasks_queued() { return task_queue_.size(); }
+        [[nodiscard]] std::size_t tasks_queued() const { return task_queue_.size(); }
+        [[nodiscard]] log_stats stats() const;
+        // where the log will be once everything queued so far is written (simulation thread only)
+        [[nodiscard]] log_position position() const;
         [[nodiscard]] bool initialized() const { return initialized_; }
+        [[nodiscard]] bool appending() const { return appending_; }
     };
 
 } // namespace swarmulator
@@ -0,0 +1,148 @@
+//
+// Created by moltma on 11/6/25.
+//
+
+#ifndef SWARMULATOR_CPP_MPSCRING_H
+#define SWARMULATOR_CPP_MPSCRING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace swarmulator {
+    /*
+     * bounded lock-free ring buffer, many producers and a single consumer
+     * every slot carries a sequence number that says whose turn it is (dmitry vyukov's bounded queue):
+     * producers claim a slot with one compare-and-swap on the enqueue position, fill it in place, then hand it to the consumer by bumping its sequence
+     * the consumer processes slots in place, in claim order, and hands them back the same way
+     * slots are never destroyed, so anything they own (vectors etc.) keeps its memory between laps - once the ring is warm, pushing doesn't allocate
+     * when the ring is full, producers back off until the consumer catches up, so it doubles as back-pressure
+     */
+    template<typename T>
+    class MpscRing {
+    private:
+        struct slot {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        std::vector<slot> slots_;
+        size_t mask_;
+        alignas(64) std::atomic<size_t> enqueue_pos_{0}; // written by producers
+        alignas(64) std::atomic<size_t> dequeue_pos_{0}; // only ever written by the consumer
+        std::atomic<bool> stopped_{false};
+
+        // spin a little, then yield, then sleep - the logger isn't latency critical, but it shouldn't burn a core while idle
+        static void back_off(unsigned int &attempt) {
+            if (attempt < 64) {
+                // busy wait
+            }
+            else if (attempt < 128) {
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            ++attempt;
+        }
+
+    public:
+        // capacity must be a power of 2
+        explicit MpscRing(const size_t capacity) : slots_(capacity), mask_(capacity - 1) {
+            if (capacity < 2 || (capacity & mask_) != 0) {
+                throw std::runtime_error("Ring capacity must be a power of 2.");
+            }
+            for (size_t i = 0; i < capacity; i++) {
+                slots_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        // claim a slot and call fill(T&) on it
+        // returns false without calling fill if the ring is full
+        template<class F>
+        bool try_push(F&& fill) {
+            size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+            slot* s;
+            while (true) {
+                s = &slots_[pos & mask_];
+                const size_t seq = s->sequence.load(std::memory_order_acquire);
+                const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                if (diff == 0) {
+                    // the slot is free on this lap, try to claim it
+                    if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if (diff < 0) {
+                    // the consumer hasn't handed this slot back yet
+                    return false;
+                }
+                else {
+                    // someone else claimed it first
+                    pos = enqueue_pos_.load(std::memory_order_relaxed);
+                }
+            }
+            fill(s->data);
+            s->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // like try_push, but waits for room instead of giving up
+        template<class F>
+        void push(F&& fill) {
+            unsigned int attempt = 0;
+            while (!try_push(fill)) {
+                back_off(attempt);
+            }
+        }
+
+        // call consume(T&) on the oldest filled slot, then hand the slot back
+        // returns false without calling consume if there is nothing to consume
+        // single consumer only!
+        template<class F>
+        bool try_pop(F&& consume) {
+            const size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+            slot& s = slots_[pos & mask_];
+            const size_t seq = s.sequence.load(std::memory_order_acquire);
+            if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) {
+                return false;
+            }
+            consume(s.data);
+            s.sequence.store(pos + mask_ + 1, std::memory_order_release);
+            dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // like try_pop, but waits for something to come in
+        // returns false once the ring has been stopped and everything pushed before that is consumed
+        template<class F>
+        bool pop(F&& consume) {
+            unsigned int attempt = 0;
+            while (!try_pop(consume)) {
+                if (stopped_.load(std::memory_order_acquire)) {
+                    // anything pushed before stop is visible now, so one more look settles it
+                    return try_pop(consume);
+                }
+                back_off(attempt);
+            }
+            return true;
+        }
+
+        // approximate while producers are running
+        [[nodiscard]] size_t size() const {
+            return enqueue_pos_.load(std::memory_order_relaxed) - dequeue_pos_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] size_t capacity() const { return slots_.size(); }
+
+        // no more pushes are coming, let the consumer drain and finish
+        void stop() {
+            stopped_.store(true, std::memory_order_release);
+        }
+    };
+} // namespace swarmulator
+
+#endif // SWARMULATOR_CPP_MPSCRING_H
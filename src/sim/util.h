@@ -12,10 +12,18 @@
 #include <string>
 #include <sstream>
 
+#include "Random.h"
+
 namespace swarmulator {
-    // get a random float between 0 and 1
+    // get a random float between 0 and 1 (excluding 1)
+    // every call is the next number of the process-wide draw counter (see Random.h): no locks, and the same numbers for the same seed
+    // as long as it's only called from one thread - inside the update, use a random_stream keyed by object and step instead
     inline float randfloat() {
-        return static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+        const auto n = random_draws_ref().fetch_add(1, std::memory_order_relaxed);
+        const auto seed = random_seed();
+        const auto words = philox::block({static_cast<uint32_t>(n / 4), static_cast<uint32_t>(random_purpose::draw), static_cast<uint32_t>(n >> 34), 0},
+                                         {static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)});
+        return philox::to_unit(words[n % 4]);
     }
 
     /*inline unsigned int init_agent_mesh() {
@@ -96,6 +104,11 @@ namespace swarmulator {
 
     [[nodiscard]] static float wrap(float x, const float min, const float max) {
         const float range = max - min;
+        // objects move much less than a world per update, so they are either in bounds or at most one world out
+        // which needs no fmod
+        if (x < min) x += range;
+        else if (x >= max) x -= range;
+        if (x >= min && x < max) return x;
         x = std::fmod(x - min, range);
         if (x < 0) x += range;
         return x + min;